@@ -19,6 +19,93 @@ assert()
 
 }
 
+# -fprofile-generateで実行した結果から-fprofile-useで再コンパイルしても同じ結果になるか
+assert_pgo()
+{
+	expected="$1"
+	input="$2"
+
+	rm -f ./tmp.prof
+	./mcc -fprofile-generate=./tmp.prof "$input" > ./tmp.s
+	cc -o ./tmp ./tmp.s func_test.o
+	./tmp
+	generated="$?"
+	./mcc -fprofile-use=./tmp.prof "$input" > ./tmp.s
+	cc -o ./tmp ./tmp.s func_test.o
+	./tmp
+	actual="$?"
+
+	if [ "$generated" = "$expected" ] && [ "$actual" = "$expected" ]; then
+		echo "[pgo] $input -> $actual"
+	else
+		echo "[pgo] $input -> $expected : actual -> $generated, $actual"
+		exit 1
+	fi
+}
+
+# トークナイザの走査の命令セットによらず同じ結果になるか(使えない命令セットは使えるものに落ちる)
+assert_scan()
+{
+	expected="$1"
+	input="$2"
+
+	for level in scalar sse2 avx2; do
+		./mcc -fscan=$level "$input" > ./tmp.s
+		cc -o ./tmp ./tmp.s func_test.o
+		./tmp
+		actual="$?"
+		if [ "$actual" != "$expected" ]; then
+			echo "[scan=$level] $input -> $expected : actual -> $actual"
+			exit 1
+		fi
+	done
+	echo "[scan] $input -> $actual"
+}
+
+# フレームポインタを使わなくても同じ結果になるか(第3引数があれば変数の指し方も確かめる)
+assert_omit()
+{
+	expected="$1"
+	input="$2"
+
+	./mcc -fomit-frame-pointer "$input" stats > ./tmp.s 2> ./tmp.stats
+	cc -o ./tmp ./tmp.s func_test.o
+	./tmp
+	actual="$?"
+	if [ "$actual" != "$expected" ]; then
+		echo "[omit] $input -> $expected : actual -> $actual"
+		exit 1
+	fi
+	if [ -n "$3" ] && ! grep -q "addressed from $3\$" ./tmp.stats; then
+		echo "[omit] $input -> locals not addressed from $3"
+		exit 1
+	fi
+	if grep -q rbp ./tmp.s; then
+		echo "[omit] $input -> rbp is used"
+		exit 1
+	fi
+	echo "[omit] $input -> $actual"
+}
+
+# コンパイルサーバ経由(mcc_client)でも同じ結果になるか
+assert_server()
+{
+	expected="$1"
+	input="$2"
+
+	MCC_SOCKET=./tmp.sock ./mcc_client "$input" > ./tmp.s
+	cc -o ./tmp ./tmp.s func_test.o
+	./tmp
+	actual="$?"
+
+	if [ "$actual" = "$expected" ]; then
+		echo "[server] $input -> $actual"
+	else
+		echo "[server] $input -> $expected : actual -> $actual"
+		exit 1
+	fi
+}
+
 assert 47 '5 +6 *7;'
 assert 15 '5*(  9- 6 );'
 assert 4 '(3 +5 )/ 2;'
@@ -39,11 +126,19 @@ assert 0 "1+2*3 < 4/5;"
 assert 1 "1+2*3+4 <= 5*6;"
 
 assert 1 "(5*6==30)>=(7!=21/3);"
+assert 1 "5 > 3 == 1;"
+assert 1 "1 < 2 > 0;"
+assert 4 "-(2*3)+10;"
+assert 3 "$(printf '%.0s(' $(seq 50000))3$(printf '%.0s)' $(seq 50000));"
 
 assert 85 "a=12/4; b =4* 5-1; c = a+b; z = c*a+b;"
 assert 1 "a=3;f=2; d=(a!=f);"
+assert 6 "a = b = 3; a + b;"
 assert 121 "hoge = 1+2*3; foo = 4+(5-6); bar=(foo*hoge)+100;"
 
+assert 252 "a=1;b=2;c=3; a-(b*(c-a)) - (c/(a+a));"
+assert 95 "a=7;b=2; 100 - a*(b+1) / (b*b);"
+assert 49 "$(printf '1+%.0s' $(seq 30000))1;"
 assert 12 "aiueo = 4*3/5; gdaga=(1+2)*aiueo; return gdaga*aiueo;"
 
 assert 129 "a=1; if(a==1) return 129; return 4;"
@@ -65,5 +160,142 @@ assert 202 "a=3;b=3;if(a==3) { a=100; b=a+2; } return a+b;"
 assert 199 "a=0; b = 2; c = 0; while(a<100){ b = a + 1; a = b + 1; c = a + b;} return c;"
 
 assert 10 "a=0; b=0; while(a<10){ if((a+b)/2 == 0) { foo(); } else { b = -a; } a = a+1; } return a;"
+assert 6 "a=1; { { a=a+1; } a=a*3; } return a;"
+assert 7 "a=0; while(1){ a=a+1; if(a==7) break; } return a;"
+assert 5 "a=5; while(a<3) a=a+1; return a;"
+assert 4 "a=0; while(tick() < 5) a = a + 1; return a;"
+assert 36 "i=0; s=0; while(i<3){ j=0; while(j<4){ k=0; while(k<3){ s=s+1; k=k+1; } j=j+1; } i=i+1; } return s;"
+assert 10 "i=0; s=0; while(i<5){ s=s+i; i=i+1; } return s;"
+assert 253 "n=23; i=0; s=0; while(i<n){ s=s+i; i=i+1; } return s;"
+assert 32 "n=3; int i=20; s=0; while(i>=n){ s=s+1; i=i-3; } return s*5+i;"
+assert 94 "int i=7; s=0; while(i<=40){ s=s+i; i=2+i; } return s-i;"
+assert 5 "n=10; i=0; while(i<n){ n=n-1; i=i+1; } return i;"
+
+assert 20 "a=2; switch(a){ case 1: return 10; case 2: return 20; default: return 30; }"
+assert 30 "a=5; switch(a){ case 1: return 10; case 2: return 20; default: return 30; }"
+assert 225 "r=0; a=0; while(a<8){ switch(a){ case 0: r=r+1; break; case 1: r=r+2; break; case 2: r=r+3; case 3: r=r+4; break; case 4: r=r+5; break; case 5: r=r+6; break; default: r=r+100; } a=a+1; } return r;"
+assert 21 "r=0; a=0-2; while(a<300){ switch(a){ case -2: r=r+1; break; case 7: r=r+2; break; case 40: r=r+3; break; case 100: r=r+4; break; case 250: r=r+5; break; case 299: r=r+6; break; } a=a+1; } return r;"
+assert 11 "a=3;b=1; switch(a){ case 3: switch(b){ case 1: a=10; break; default: a=20; } a=a+1; break; case 4: a=0; } return a;"
+assert 5 "a=1; switch(a){ case 1: switch(a){ case 1: a=5; } } return a;"
+# 重複したcaseは2つ目のcaseを指して弾く
+if ./mcc "switch(1){ case 1: case 1: a=1; }" > /dev/null 2> ./tmp.err; then echo "duplicate case was accepted"; exit 1; fi
+if [ "$(sed -n 2p ./tmp.err)" != "                   ^ duplicate case value 1." ]; then echo "duplicate case was not located"; exit 1; fi
+
+assert 5 "int a; a = 65536*65536+5; return a;"
+assert 1 "a = 65536*65536+5; return a/65536/65536;"
+assert 9 "int a = 3; int b = a*2; return a+b;"
+assert 15 "i=0; y=0; x=0; while(i<3){ if(i==0) x=5; y=y+x; i=i+1;} return y;"
+assert 1 "i=0; while(i<3){ if(i==2) break; x = i; t=7; t=t+1; i=i+1;} return x;"
+assert 23 "i=0; s=0; while(i<5){ t = i*2; s = s + t; u = s; i=i+1; } v = 3; return u + v;"
+assert 52 "$(for v in {a..z}{a..b}; do printf "$v=1;"; done) s=0; $(for v in {a..z}{a..b}; do printf "s=s+$v;"; done) return s;"
+
+assert 12 "a=3;b=5; x=(a+b)/2; y=a+b; return x+y;"
+assert 28 "a=3;b=5; c=(a+b)*2; a=1; d=(a+b)*2; return c+d;"
+assert 64 "a=3;b=5; c=a*b+1; d=b*a+1; e=(b*a+1)*2; return c+d+e;"
+assert 16 "int a=3; int b=5; int c=a+b; int d=a+b; return c+d;"
+assert 26 "a=3;b=5; c=a+b; foo(); d=(a+b)+(a+b); if (c == 8) d = d + (a+b)*0 + 2; return c+d;"
+
+# 分岐のないcmov/setccへの変換(除算は投機的に評価しない，腕が1つなら最後の文の値を変えない)
+assert 3 "a=3; b=5; if (a < b) c = a; else c = b; return c;"
+assert 5 "a=7; b=5; if (a < b) c = a; else c = b; return c;"
+assert 4 "y=4; x=0; if (x) y = 9; return y;"
+assert 9 "y=4; x=2; if (x) { y = 9; } return y;"
+assert 0 "y=4; x=0; if (x) y = 9;"
+assert 0 "y=4; x=tick()-1; if (x) y = 9; {}"
+assert 0 "y=4; x=tick()-1; if (x) y = 9; int z;"
+assert 1 "a=2; if (a == 2) b = 1; else b = 0; return b;"
+assert 1 "a=2; if (a <= 1) b = 0; else b = 1; return b;"
+assert 7 "c=0; a=5; b=0; if (b != 0) c = a / b; else c = 7; return c;"
+assert 2 "int m=0; a=-3; if (a < 0) m = 0 - a - 1; else m = a; return m;"
+assert 45 "i=0; s=0; while(i<10){ if (i - i/2*2 == 0) t = i; else t = i * 2; s = s + t; i = i + 1; } return s - 25;"
+./mcc "a=tick()+2; b=5; if (a < b) c = a; else c = b; return c;" > ./tmp.s
+if ! grep -q cmovge ./tmp.s; then echo "if was not converted"; exit 1; fi
+./mcc -fno-if-conversion "a=tick()+2; b=5; if (a < b) c = a; else c = b; return c;" > ./tmp.s
+if grep -q cmov ./tmp.s; then echo "-fno-if-conversion was ignored"; exit 1; fi
+if ! ./mcc "a=tick()+2; b=5; if (a < b) c = a; else c = b; return c;" node > /dev/null 2>&1; then echo "node dump of a select failed"; exit 1; fi
+
+# 定数/コピーの伝播と実行されない分岐の除去(0除算や64bitの桁あふれは実行時と同じにする)
+assert 60 "a=12/4; b=4*5-1; c=a+b; z=c*a+b; return z-c-a;"
+assert 129 "a=1; if (a == 1) return 129; return 3;"
+assert 6 "a=2; switch(a){ case 1: r=1; break; case 2: r=6; break; default: r=9; } return r;"
+assert 2 "a=2; b=a; a=5; return b;"
+assert 5 "int a; b = 65536*65536+5; a = b; c = a; return c;"
+assert 8 "i=0; a=4; while(i<3){ if (a != 4) a = 100; i=i+1; } return a+i+1;"
+assert 1 "a=0; b=0; if (b) a = 1/b; else a = 1; return a;"
+./mcc "a=1; b=2; if (a < b) c = 3; else c = foo(); return c;" > ./tmp.s
+if grep -q "call foo" ./tmp.s; then echo "dead branch was not removed"; exit 1; fi
+
+# 即値/メモリオペランドの命令選択(入れ替えた引き算/割り算/比較，intの切り詰め，文の値)
+assert 4 "a=tick()+2; b=10-a*2; return b;"
+assert 49 "a=tick()+99; b=7; c=a/b; d=200/(b+tick()+1); e=(a+b)/b; return c+d+e;"
+assert 3 "a=tick()+4; return (3 < a) + (3 <= a*1) + (a*1 < 3) + (a == 5);"
+assert 1 "int a=tick()+2147483646; a = a + 1; return a < 0;"
+assert 5 "int a=tick(); b=tick(); a=a+b; b=b-a; return a*2+b;"
+assert 0 "i=tick(); while(i<3) i=i+1;"
+assert 3 "i=tick(); while(i<3) i=i+1; i;"
+# 全部展開したループが最後の文でも値は抜けたときの条件(0)
+assert 0 "a=0; while(a<3) a=a+1;"
+assert 0 "int a=tick(); b=0; while(b<2) b=b+1;"
+assert 0 "a=5; b=0; while(b<0) b=b+1;"
+./mcc "i=tick(); s=0; while(i<100){ s=s+i; i=i+1; } return s;" > ./tmp.s
+if ! grep -q "inc qword ptr \[rbp - " ./tmp.s || ! grep -q "cmp qword ptr \[rbp - [0-9]*\], 100" ./tmp.s; then echo "memory operands were not used"; exit 1; fi
+./mcc -fno-isel "i=tick(); s=0; while(i<100){ s=s+i; i=i+1; } return s;" > ./tmp.s
+if grep -q "qword ptr \[rbp" ./tmp.s; then echo "-fno-isel was ignored"; exit 1; fi
+if ! ./mcc "$(printf 'f%.0s' {1..120})();" > ./tmp.s || ! grep -q "call f\{120\}$" ./tmp.s; then echo "long function name failed"; exit 1; fi
+for input in "1 = 2;" "(a+1) = 3;"; do
+	./mcc "$input" > /dev/null 2>&1
+	if [ "$?" != 1 ]; then echo "$input was not rejected"; exit 1; fi
+done
+
+# ループの回転/先頭の揃え/展開，if変換，定数の伝播，命令選択は結果を変えない
+for flags in "-fno-rotate-loops" "-falign-loops=1" "-falign-loops=64" "-fno-unroll-loops" "-funroll-loops=3" "-fno-if-conversion" "-fno-ccp" "-fno-isel"; do
+	./mcc $flags "i=0;j=0;while(i<9) while(j<10) if(i != j) i = i + 1; else j = j + 1; return (i+j);" > ./tmp.s
+	cc -o ./tmp ./tmp.s func_test.o
+	./tmp
+	if [ "$?" != 19 ]; then echo "[$flags] nested while failed"; exit 1; fi
+done
+if ./mcc -falign-loops=3 "a=1;" > /dev/null 2>&1; then echo "-falign-loops=3 was accepted"; exit 1; fi
+if ./mcc -funroll-loops=0 "a=1;" > /dev/null 2>&1; then echo "-funroll-loops=0 was accepted"; exit 1; fi
+
+assert_omit 19 "a=3; b=4; if (a<b) return a*b+(a+b)*(b-a); return 0;" "red zone"
+assert_omit 127 "a=1; while(a<100) { a = a*2; if (a > 40) return a + (a - 1); } return 0;" "red zone"
+assert_omit 6 "int a=1; b=2; int c=3; return a+b+c;" "red zone"
+assert_omit 24 "a=3;b=5; c=a+b; foo(); d=(a+b)+(a+b); return c+d;" "rsp"
+assert_omit 98 "$(for v in {a..z}{a..b}; do printf "$v=tick();"; done) s=0; $(for v in {a..z}{a..b}; do printf "s=s+$v;"; done) return s;" "rsp"
+assert_omit 14 "i=1; s=0; while(i<100){ k=0; $(for v in {a..z}{a..b}; do printf "$v=i+k; k=k+1;"; done) $(for v in {a..z}{a..b}; do printf "s=s+$v;"; done) i=i*2; } return s - s/256*256;" "rsp"
+assert_omit 10 "a=0; b=0; while(a<10){ if((a+b)/2 == 0) { foo(); } else { b = -a; } a = a+1; } return a;"
+
+# 16/32Byteをまたぐ空白/識別子/数字の連続
+assert_scan 42 "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrst = 42;                                        return abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrst;"
+assert_scan 7 "a=0000000000000000000000000000007;   																								 return a;"
+assert_scan 30 "x = 123456789012 - 123456789000 + 9; y = 87654321 - 87654320; return x + y * 0 + 00000000000000000000008 + y;"
+
+assert_pgo 8 "i=0; c=0; while(i<1000){ if(i == 500) c = c + 7; else c = c + 1; if (i==3) { c = c + 2; } i = i + 1; } return c - 1000;"
+assert_pgo 40 "a=100; while(a>40) a= a- 1; return a;"
+assert_pgo 19 "i=0;j=0;while(i<9) while(j<10) if(i != j) i = i + 1; else j = j + 1; return (i+j);"
+assert_pgo 10 "a=0; b=0; while(a<10){ if((a+b)/2 == 0) { foo(); } else { b = -a; } a = a+1; } return a;"
+assert_pgo 91 "i=0; s=0; while(i<100){ if (i == 7) s = s - 1; else s = s + 1; i = i + 1; } return s - 7;"
+# 読めないプロファイルは警告してプロファイルなしでコンパイルする
+rm -f ./tmp.prof
+if ! ./mcc -fprofile-use=./tmp.prof "a=1; if (a) a=2; return a;" > ./tmp.s 2> ./tmp.err || ! grep -q "Cannot read profile" ./tmp.err; then echo "missing profile was not a warning"; exit 1; fi
+# プロファイルの名前に"や\が入っていても書き出せる
+rm -f './tmp"a\b.prof'
+./mcc -fprofile-generate='./tmp"a\b.prof' "i=tick(); while(i<3) i=i+1; return i;" > ./tmp.s
+cc -o ./tmp ./tmp.s func_test.o
+./tmp
+if [ ! -s './tmp"a\b.prof' ]; then echo "profile path was not escaped"; exit 1; fi
+rm -f './tmp"a\b.prof'
+
+rm -f ./tmp.sock
+./mcc --server=./tmp.sock 2> /dev/null &
+server=$!
+trap 'kill $server 2> /dev/null' EXIT
+while [ ! -S ./tmp.sock ]; do sleep 0.1; done
+assert_server 47 '5 +6 *7;'
+assert_server 225 "r=0; a=0; while(a<8){ switch(a){ case 0: r=r+1; break; case 1: r=r+2; break; case 2: r=r+3; case 3: r=r+4; break; case 4: r=r+5; break; case 5: r=r+6; break; default: r=r+100; } a=a+1; } return r;"
+assert_server 12 "a=3;b=5; x=(a+b)/2; y=a+b; return x+y;"
+if MCC_SOCKET=./tmp.sock ./mcc_client "a=(3;" > /dev/null 2>&1; then echo "[server] error was not reported"; exit 1; fi
+if MCC_SOCKET=./tmp.sock ./mcc_client "1 = 2;" > /dev/null 2>&1; then echo "[server] error was not reported"; exit 1; fi
+assert_server 6 "a=1; b=2; c=3; return a+b+c;"
 
 echo "OK"
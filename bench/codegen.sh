@@ -0,0 +1,75 @@
+#!/bin/bash
+# 生成コードの速度をgcc -O0/-O2と比べる
+# ./codegen.sh [mccのパス] (環境変数 MCC_FLAGS でmccのオプションを渡せる)
+# bench/codegen/*.mcc はmccの入力であり，int main() { ... } で包めばCとしても正しいプログラム
+MCC=${1:-./mcc}
+FUNC_TEST=${FUNC_TEST:-$(dirname "$MCC")/func_test.o}
+DIR=$(cd "$(dirname "$0")" && pwd)/codegen
+RUNS=${RUNS:-3}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# perf statが使えればサイクル数と命令数，使えなければ実時間(RUNS回の最小値)
+if perf stat -x, -e cycles,instructions true > /dev/null 2>&1; then
+	METRIC=cycles
+else
+	METRIC=ms
+fi
+
+# 計測値を1行で返す: "主指標 命令数(なければ-)"
+measure()
+{
+	if [ "$METRIC" = "cycles" ]; then
+		perf stat -x, -e cycles,instructions -o "$WORK/perf.txt" "$1" > /dev/null
+		cycles=$(awk -F, '$3 ~ /^cycles/ { print $1 }' "$WORK/perf.txt")
+		instructions=$(awk -F, '$3 ~ /^instructions/ { print $1 }' "$WORK/perf.txt")
+		echo "$cycles $instructions"
+		return
+	fi
+	best=
+	for n in $(seq "$RUNS"); do
+		start=$(date +%s%N)
+		"$1" > /dev/null
+		end=$(date +%s%N)
+		time=$(( (end - start) / 1000000 ))
+		if [ -z "$best" ] || [ "$time" -lt "$best" ]; then best=$time; fi
+	done
+	echo "$best -"
+}
+
+printf "%-10s %12s %12s %12s %8s %8s %12s\n" "program" "mcc" "gcc-O0" "gcc-O2" "vs-O0" "vs-O2" "mcc-insns"
+printf "%s\n" "$METRIC" > "$WORK/ratios.txt"
+status=0
+for file in "$DIR"/*.mcc; do
+	name=$(basename "$file" .mcc)
+	src=$(cat "$file")
+
+	"$MCC" $MCC_FLAGS "$src" > "$WORK/$name.s" || { echo "$name: mcc failed"; status=1; continue; }
+	cc -o "$WORK/$name.mcc" "$WORK/$name.s" "$FUNC_TEST" 2> /dev/null || { echo "$name: assemble failed"; status=1; continue; }
+	printf "int tick(void);\nvoid foo(void);\nint main(void)\n{\n%s\n}\n" "$src" > "$WORK/$name.c"
+	cc -O0 -w -o "$WORK/$name.O0" "$WORK/$name.c" "$FUNC_TEST"
+	cc -O2 -w -o "$WORK/$name.O2" "$WORK/$name.c" "$FUNC_TEST"
+
+	# 結果が一致しなければ比べる意味がない
+	"$WORK/$name.mcc" > /dev/null; expected=$?
+	"$WORK/$name.O0" > /dev/null; actual=$?
+	if [ "$expected" != "$actual" ]; then echo "$name: exit code mismatch (mcc $expected, gcc $actual)"; status=1; continue; fi
+
+	read mcc mccInsns <<< "$(measure "$WORK/$name.mcc")"
+	read o0 o0Insns <<< "$(measure "$WORK/$name.O0")"
+	read o2 o2Insns <<< "$(measure "$WORK/$name.O2")"
+	awk -v name="$name" -v mcc="$mcc" -v o0="$o0" -v o2="$o2" -v insns="$mccInsns" 'BEGIN {
+		# 1未満は1として割る(gcc -O2はループごと消えることがある)
+		r0 = mcc / (o0 < 1 ? 1 : o0); r2 = mcc / (o2 < 1 ? 1 : o2);
+		printf("%-10s %12s %12s %12s %7.2fx %7.2fx %12s\n", name, mcc, o0, o2, r0, r2, insns);
+	}'
+	echo "$mcc $o0 $o2" >> "$WORK/ratios.txt"
+done
+
+# 相対的な遅さの幾何平均
+awk 'NR == 1 { metric = $1; next } {
+	n++; l0 += log($1 / ($2 < 1 ? 1 : $2)); l2 += log($1 / ($3 < 1 ? 1 : $3));
+} END {
+	if (n > 0) printf("geomean slowdown (%s): %.2fx vs gcc -O0, %.2fx vs gcc -O2\n", metric, exp(l0 / n), exp(l2 / n));
+}' "$WORK/ratios.txt"
+exit $status
@@ -0,0 +1,34 @@
+#!/bin/bash
+# 変数の領域の共有とint(4Byte)の詰め込みによるフレームの縮小と実行時間を比べる
+# ./frame.sh [mccのパス]
+MCC=${1:-./mcc}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# 反復ごとに使い捨てる一時変数が多いループ
+BODY="i=0; s=0; while(i<20000000){ a=i*3; b=a+1; s=s+b; c=i*5; d=c+2; s=s+d; e=i*7; f=e+3; s=s+f; g=i*11; h=g+4; s=s+h; i=i+1; } return s/1000;"
+DECL="int i; int a; int b; int c; int d; int e; int f; int g; int h;"
+
+run()
+{
+	name="$1"
+	shift
+	"$MCC" "$@" stats > "$WORK/$name.s" 2> "$WORK/$name.txt" || exit 1
+	cc -o "$WORK/$name" "$WORK/$name.s" || exit 1
+	# 5回の最小値
+	elapsed=
+	for n in 1 2 3 4 5; do
+		start=$(date +%s%N)
+		"$WORK/$name"
+		status=$?
+		end=$(date +%s%N)
+		time=$(( (end - start) / 1000000 ))
+		if [ -z "$elapsed" ] || [ "$time" -lt "$elapsed" ]; then elapsed=$time; fi
+	done
+	echo "$name: $(cat "$WORK/$name.txt"), exit $status, ${elapsed} ms" >&2
+	echo "$elapsed"
+}
+
+legacy=$(run legacy -fstack-reuse=none "$BODY")
+packed=$(run packed "$DECL $BODY")
+awk -v a="$legacy" -v b="$packed" 'BEGIN { if (b > 0) printf("speedup: %.2fx\n", a / b); }'
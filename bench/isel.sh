@@ -0,0 +1,34 @@
+#!/bin/bash
+# 命令選択(即値/メモリオペランドの埋め込み)の有無で生成される命令数を比べる
+# ./isel.sh [mccのパス] [mccのオプション...]
+# auto_test/auto_test.shのassertのプログラムごとに静的な命令数(ラベルと疑似命令を除く行数)を数える
+MCC=${1:-./mcc}
+shift
+DIR=$(cd "$(dirname "$0")" && pwd)
+
+# assert系の行をそのまま評価してプログラムを取り出す($(...)で作るプログラムも展開される)
+programs()
+{
+	assert() { printf '%s\0' "$2"; }
+	assert_omit() { printf '%s\0' "$2"; }
+	assert_pgo() { printf '%s\0' "$2"; }
+	assert_scan() { printf '%s\0' "$2"; }
+	assert_server() { printf '%s\0' "$2"; }
+	grep -E '^assert(_[a-z]+)? ' "$DIR/../auto_test/auto_test.sh" | while IFS= read -r line; do eval "$line"; done
+}
+count()
+{
+	"$MCC" "$@" | grep -c -E '^  [^.]'
+}
+
+total_before=0
+total_after=0
+printf "%8s %8s %6s  %s\n" "before" "after" "ratio" "program"
+while IFS= read -r -d '' src; do
+	before=$(count -fno-isel "$@" "$src") || exit 1
+	after=$(count "$@" "$src") || exit 1
+	total_before=$((total_before + before))
+	total_after=$((total_after + after))
+	awk -v a="$before" -v b="$after" -v s="${src:0:60}" 'BEGIN { printf("%8d %8d %6.2f  %s\n", a, b, b / a, s); }'
+done < <(programs)
+awk -v a="$total_before" -v b="$total_after" 'BEGIN { printf("%8d %8d %6.2f  total\n", a, b, b / a); }'
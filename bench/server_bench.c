@@ -0,0 +1,130 @@
+// コンパイルサーバへの要求と，要求ごとのプロセス起動(fork+exec)の処理速度を比べる
+// usage: bench_server [反復回数] (srcディレクトリで実行する)
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mcc.h"
+
+static const char* const sources[] =
+{
+	"5 +6 *7;",
+	"a=12/4; b =4* 5-1; c = a+b; z = c*a+b;",
+	"a=3; if(a==1) return 129; else if(a==2) return 5; else if (a==3) return 9; return 4;",
+	"i=0;j=0;while(i<9) while(j<10) if(i != j) i = i + 1; else j = j + 1; return (i+j);",
+	"r=0; a=0; while(a<8){ switch(a){ case 0: r=r+1; break; case 1: r=r+2; break; case 2: r=r+3; case 3: r=r+4; break; default: r=r+100; } a=a+1; } return r;",
+};
+#define SOURCE_SIZE ((int)(sizeof(sources)/sizeof(sources[0])))
+
+static double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+// 出力を捨ててプログラムを実行し，終了コードを返す
+static int Spawn(char* const argv[], const char* const pSocketPath)
+{
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0)
+	{
+		const int fd = open("/dev/null", O_WRONLY);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (pSocketPath != NULL) { setenv(MCC_SOCKET_ENV, pSocketPath, 1); }
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+// 1要求ごとにプロセスを起動する
+static double BenchSpawn(const char* const pProgram, const char* const pSocketPath, const int iteration)
+{
+	const double start = Now();
+	for (int i = 0; i < iteration; ++i)
+	{
+		char* argv[] = {(char*)pProgram, (char*)sources[i % SOURCE_SIZE], NULL};
+		if (Spawn(argv, pSocketPath) != 0) { fprintf(stderr, "%s failed\n", pProgram); exit(1); }
+	}
+	return iteration / (Now() - start);
+}
+// 1つの接続で要求を続ける
+static double BenchConnection(const char* const pSocketPath, const int iteration)
+{
+	const int fd = ConnectServer(pSocketPath);
+	assert(fd >= 0);
+	struct OutBuffer out = {NULL, 0, 0};
+	struct OutBuffer err = {NULL, 0, 0};
+
+	const double start = Now();
+	for (int i = 0; i < iteration; ++i)
+	{
+		char* argv[] = {(char*)sources[i % SOURCE_SIZE]};
+		int status = 0;
+		if (!SendRequest(fd, ".", 1, argv) || !ReceiveResponse(fd, &status, &out, &err) || status != 0)
+		{
+			fprintf(stderr, "request failed\n");
+			exit(1);
+		}
+	}
+	const double elapsed = Now() - start;
+
+	close(fd);
+	free(out.pData);
+	free(err.pData);
+	return iteration / elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+	const int iteration = (argc >= 2) ? atoi(argv[1]) : 1000;
+	char socketPath[MCC_SOCKET_PATH_MAX];
+	snprintf(socketPath, sizeof(socketPath), "/tmp/mcc-bench-%d.sock", (int)getpid());
+
+	// サーバを起動して待ち受けるまで待つ
+	const pid_t server = fork();
+	assert(server >= 0);
+	if (server == 0)
+	{
+		char option[MCC_SOCKET_PATH_MAX + 16];
+		snprintf(option, sizeof(option), "--server=%s", socketPath);
+		const int fd = open("/dev/null", O_WRONLY);
+		dup2(fd, STDERR_FILENO);
+		execl("./mcc", "./mcc", option, (char*)NULL);
+		_exit(127);
+	}
+	int fd = -1;
+	for (int i = 0; i < 500 && fd < 0; ++i)
+	{
+		fd = ConnectServer(socketPath);
+		if (fd < 0) { nanosleep(&(struct timespec){0, 10 * 1000 * 1000}, NULL); }
+	}
+	if (fd < 0) { fprintf(stderr, "server did not start\n"); kill(server, SIGTERM); return 1; }
+	close(fd);
+
+	const double spawnRate = BenchSpawn("./mcc", NULL, iteration);
+	const double clientRate = BenchSpawn("./mcc_client", socketPath, iteration);
+	const double connectionRate = BenchConnection(socketPath, iteration * 10);
+
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+	unlink(socketPath);
+
+	printf("%-24s %12s %8s\n", "mode", "requests/s", "speedup");
+	printf("%-24s %12.0f %7.2fx\n", "fork+exec mcc", spawnRate, 1.0);
+	printf("%-24s %12.0f %7.2fx\n", "fork+exec mcc_client", clientRate, clientRate / spawnRate);
+	printf("%-24s %12.0f %7.2fx\n", "persistent connection", connectionRate, connectionRate / spawnRate);
+	return 0;
+}
@@ -0,0 +1,139 @@
+// 複数スレッドで同時にmcc_compileを呼び，結果が単一スレッドと一致するかと処理速度を測る
+// usage: bench_thread [反復回数] [最大スレッド数]
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mcc.h"
+
+static const char* const sources[] =
+{
+	"5 +6 *7;",
+	"a=12/4; b =4* 5-1; c = a+b; z = c*a+b;",
+	"a=3; if(a==1) return 129; else if(a==2) return 5; else if (a==3) return 9; return 4;",
+	"i=0;j=0;while(i<9) while(j<10) if(i != j) i = i + 1; else j = j + 1; return (i+j);",
+	"a=0; b = 2; c = 0; while(a<100){ b = a + 1; a = b + 1; c = a + b;} return c;",
+	"a=0; b=0; while(a<10){ if((a+b)/2 == 0) { foo(); } else { b = -a; } a = a+1; } return a;",
+	"r=0; a=0; while(a<8){ switch(a){ case 0: r=r+1; break; case 1: r=r+2; break; case 2: r=r+3; case 3: r=r+4; break; default: r=r+100; } a=a+1; } return r;",
+	"a=1; b=(c=3;", // エラー
+};
+#define SOURCE_SIZE ((int)(sizeof(sources)/sizeof(sources[0])))
+
+struct Expected
+{
+	enum MccResult result;
+	char* pText; // アセンブリまたはエラーメッセージ
+};
+static struct Expected expected[SOURCE_SIZE];
+
+struct Worker
+{
+	pthread_t thread;
+	int iteration;
+	int mismatch;
+};
+
+static double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+static char* Duplicate(const char* const pStr)
+{
+	char* const pCopy = (char*)malloc(strlen(pStr) + 1);
+	assert(pCopy != NULL);
+	strcpy(pCopy, pStr);
+	return pCopy;
+}
+static bool IsSameResult(const int index, const enum MccResult result, const struct MccContext* const pCtx, const struct OutBuffer* const pOut)
+{
+	if (result != expected[index].result) { return false; }
+	const char* const pText = (result == MCC_OK) ? pOut->pData : mcc_error_message(pCtx);
+	return strcmp(pText, expected[index].pText) == 0;
+}
+static void* RunWorker(void* pArg)
+{
+	struct Worker* const pWorker = (struct Worker*)pArg;
+	struct MccContext* const pCtx = mcc_create_context();
+	assert(pCtx != NULL);
+	struct OutBuffer out;
+	mcc_init_out_buffer(&out);
+
+	for (int n = 0; n < pWorker->iteration; ++n)
+	{
+		for (int i = 0; i < SOURCE_SIZE; ++i)
+		{
+			out.size = 0;
+			const enum MccResult result = mcc_compile(pCtx, sources[i], strlen(sources[i]), &out);
+			if (!IsSameResult(i, result, pCtx, &out)) { ++pWorker->mismatch; }
+		}
+	}
+
+	mcc_release_out_buffer(&out);
+	mcc_destroy_context(pCtx);
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	const int iteration = (argc > 1) ? atoi(argv[1]) : 2000;
+	long maxThread = (argc > 2) ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxThread < 1) { maxThread = 1; }
+
+	// 単一スレッドでの結果を基準にする
+	struct MccContext* const pCtx = mcc_create_context();
+	assert(pCtx != NULL);
+	for (int i = 0; i < SOURCE_SIZE; ++i)
+	{
+		struct OutBuffer out;
+		mcc_init_out_buffer(&out);
+		expected[i].result = mcc_compile(pCtx, sources[i], strlen(sources[i]), &out);
+		expected[i].pText = Duplicate((expected[i].result == MCC_OK) ? out.pData : mcc_error_message(pCtx));
+		mcc_release_out_buffer(&out);
+	}
+	mcc_destroy_context(pCtx);
+
+	printf("%8s %12s %14s %10s %9s\n", "threads", "compiles", "compiles/s", "speedup", "mismatch");
+	double baseRate = 0.0;
+	int failed = 0;
+	for (long threadSize = 1; threadSize <= maxThread; threadSize *= 2)
+	{
+		struct Worker* const pWorkers = (struct Worker*)calloc(threadSize, sizeof(struct Worker));
+		assert(pWorkers != NULL);
+
+		const double begin = Now();
+		for (long t = 0; t < threadSize; ++t)
+		{
+			pWorkers[t].iteration = iteration;
+			pthread_create(&pWorkers[t].thread, NULL, RunWorker, &pWorkers[t]);
+		}
+		int mismatch = 0;
+		for (long t = 0; t < threadSize; ++t)
+		{
+			pthread_join(pWorkers[t].thread, NULL);
+			mismatch += pWorkers[t].mismatch;
+		}
+		const double elapsed = Now() - begin;
+
+		const long compiles = threadSize * iteration * SOURCE_SIZE;
+		const double rate = compiles / elapsed;
+		if (threadSize == 1) { baseRate = rate; }
+		printf("%8ld %12ld %14.0f %9.2fx %9d\n", threadSize, compiles, rate, rate / baseRate, mismatch);
+		failed += mismatch;
+		free(pWorkers);
+
+		// 最大スレッド数が2のべき乗でなくても最後に測る
+		if (threadSize < maxThread && threadSize * 2 > maxThread) { threadSize = maxThread / 2; }
+	}
+
+	for (int i = 0; i < SOURCE_SIZE; ++i) { free(expected[i].pText); }
+	return (failed == 0) ? 0 : 1;
+}
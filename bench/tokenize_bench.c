@@ -0,0 +1,113 @@
+// トークナイザの走査の命令セットごとの処理速度(GB/s)を機械生成の大きな入力で測る
+// usage: bench_tokenize [入力のMB数] [反復回数]
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <setjmp.h>
+#include <time.h>
+
+#include "mcc.h"
+
+static double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+// 生成コードらしい入力: 深い字下げ，長い識別子，桁の多い定数
+static size_t Append(char* const pDst, size_t size, const char* const pStr)
+{
+	const size_t len = strlen(pStr);
+	memcpy(&pDst[size], pStr, len);
+	return size + len;
+}
+static size_t AppendRun(char* const pDst, size_t size, const char first, const char last, const int len)
+{
+	for (int i = 0; i < len; ++i) { pDst[size++] = (char)(first + rand() % (last - first + 1)); }
+	return size;
+}
+static char* GenerateSource(const size_t target, size_t* const pSize)
+{
+	char* const pSrc = (char*)malloc(target + 256 + SCAN_PADDING);
+	assert(pSrc != NULL);
+	size_t size = 0;
+	while(size < target)
+	{
+		size = AppendRun(pSrc, size, ' ', ' ', 4 * (1 + rand() % 8));
+		size = AppendRun(pSrc, size, 'a', 'z', 8 + rand() % 32);
+		size = Append(pSrc, size, " = ");
+		size = AppendRun(pSrc, size, 'a', 'z', 8 + rand() % 32);
+		size = Append(pSrc, size, " + ");
+		size = AppendRun(pSrc, size, '1', '9', 1);
+		size = AppendRun(pSrc, size, '0', '9', rand() % 12);
+		size = Append(pSrc, size, " * ");
+		size = AppendRun(pSrc, size, 'a', 'z', 8 + rand() % 32);
+		size = Append(pSrc, size, ";\n");
+	}
+	memset(&pSrc[size], '\0', 1 + SCAN_PADDING);
+	*pSize = size;
+	return pSrc;
+}
+
+// トークン列の要約(命令セットで結果が変わらないことの確認用)
+static unsigned long long HashTokens(const struct Token* pToken, const char* const pSrc)
+{
+	unsigned long long hash = 1469598103934665603ULL;
+	for (; pToken != NULL; pToken = pToken->next)
+	{
+		const long long fields[] = {pToken->kind, pToken->value, pToken->len, pToken->str - pSrc};
+		for (int i = 0; i < 4; ++i) { hash = (hash ^ (unsigned long long)fields[i]) * 1099511628211ULL; }
+	}
+	return hash;
+}
+
+int main(int argc, char* argv[])
+{
+	const size_t megaBytes = (argc >= 2) ? (size_t)atoi(argv[1]) : 16;
+	const int iteration = (argc >= 3) ? atoi(argv[2]) : 5;
+	srand(1);
+	size_t size = 0;
+	char* const pSrc = GenerateSource(megaBytes * 1024 * 1024, &size);
+
+	struct MccContext* const pCtx = mcc_create_context();
+	assert(pCtx != NULL);
+	pCtx->pSrc = pSrc;
+
+	printf("%-8s %10s %10s %8s\n", "scan", "tokens", "GB/s", "speedup");
+	double scalarRate = 0.0;
+	unsigned long long expected = 0;
+	const enum ScanLevel best = GetBestScanLevel();
+	for (int level = SCAN_SCALAR; level <= (int)best; ++level)
+	{
+		pCtx->option.scanLevel = level;
+		double elapsed = 0.0;
+		unsigned long long hash = 0;
+		int tokenCount = 0;
+		for (int i = 0; i < iteration; ++i)
+		{
+			ResetArena(&pCtx->arena);
+			pCtx->tokenMemoryCount = 0;
+			if (setjmp(pCtx->errorJump) != 0) { fprintf(stderr, "%s\n", mcc_error_message(pCtx)); return 1; }
+			const double start = Now();
+			const struct Token* const pTokens = Tokenize(pCtx, pSrc);
+			const double time = Now() - start;
+			if (i == 0 || time < elapsed) { elapsed = time; }
+			hash = HashTokens(pTokens, pSrc);
+			tokenCount = pCtx->tokenMemoryCount;
+		}
+
+		const double rate = size / elapsed / 1e9;
+		if (level == SCAN_SCALAR) { scalarRate = rate; expected = hash; }
+		printf("%-8s %10d %10.3f %7.2fx\n", GetScanner((enum ScanLevel)level)->name, tokenCount, rate, rate / scalarRate);
+		if (hash != expected) { fprintf(stderr, "%s: tokens differ from scalar\n", GetScanner((enum ScanLevel)level)->name); return 1; }
+	}
+
+	pCtx->pSrc = NULL;
+	mcc_destroy_context(pCtx);
+	free(pSrc);
+	return 0;
+}
@@ -0,0 +1,465 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "mcc.h"
+
+// 定数/コピー伝播(疎な条件付き定数伝播を文の木の上で行う)
+// 変数ごとに「定数c」「変数xと同じ値」「不明」を実行順に追い，if/switchの合流とループの先頭で交わりを取る
+// - 条件が定数のifは通る側だけを解析する．whileは入口で偽なら本体を解析しない
+// - ループは先頭の状態(入口と本体の終わりの交わり)が変わらなくなるまで解析してから書き換える
+// - 変数の読み出しを定数/元の変数に置き換え，定数になった副作用のない式を畳み込む
+// - 条件に副作用がなければ，通らないことが分かった腕とループを取り除く
+// 変数は領域(offset)ではなくLocalVarで区別する(offsetは後で決まり，区間が重ならない変数で共有される)
+// 入口ではどの変数も不明とする(初期化前の読み出しに値を仮定しない)
+// caseがswitchの本体の直下にない(if/whileの中にある)プログラムは解析しない
+
+struct Propagator
+{
+	struct MccContext* pCtx;
+	int lvarCount;
+	int stateSize;   // 使っている状態の数(後入れ先出しで確保する)
+	int breakState;  // breakで移る状態(-1はなし)
+	int switchState; // caseで移る状態(switchの条件の評価後)
+	bool isRewrite;  // 解析結果で木を書き換える
+};
+
+// -- STATE --
+// 状態: 変数ごとの値(lvarCount個)と到達するかどうか
+static struct PropValue* GetState(const struct Propagator* const pProp, const int state)
+{
+	return (struct PropValue*)pProp->pCtx->propValues.pData + (size_t)state * pProp->lvarCount;
+}
+static bool IsReachable(const struct Propagator* const pProp, const int state)
+{
+	return ((const unsigned char*)pProp->pCtx->propReachable.pData)[state] != 0;
+}
+static void SetReachable(const struct Propagator* const pProp, const int state, const bool isReachable)
+{
+	((unsigned char*)pProp->pCtx->propReachable.pData)[state] = isReachable ? 1 : 0;
+}
+// 到達しない状態を積む
+static int PushState(struct Propagator* const pProp)
+{
+	const int state = pProp->stateSize++;
+	ReserveBuffer(&pProp->pCtx->propValues, pProp->stateSize * pProp->lvarCount + 1, sizeof(struct PropValue));
+	ReserveBuffer(&pProp->pCtx->propReachable, pProp->stateSize, sizeof(unsigned char));
+	SetReachable(pProp, state, false);
+	return state;
+}
+static void PopStates(struct Propagator* const pProp, const int count)
+{
+	pProp->stateSize -= count;
+	assert(pProp->stateSize >= 0);
+}
+static void CopyState(const struct Propagator* const pProp, const int dst, const int src)
+{
+	SetReachable(pProp, dst, IsReachable(pProp, src));
+	memcpy(GetState(pProp, dst), GetState(pProp, src), (size_t)pProp->lvarCount * sizeof(struct PropValue));
+}
+static void SetVarying(const struct Propagator* const pProp, const int state)
+{
+	struct PropValue* const pValues = GetState(pProp, state);
+	for (int i = 0; i < pProp->lvarCount; ++i) { pValues[i].kind = PV_VARYING; }
+}
+static bool IsSameValue(const struct PropValue* const pA, const struct PropValue* const pB)
+{
+	if (pA->kind != pB->kind) { return false; }
+	if (pA->kind == PV_CONST) { return pA->value == pB->value; }
+	if (pA->kind == PV_COPY) { return pA->pCopy == pB->pCopy; }
+	return true;
+}
+static bool IsSameState(const struct Propagator* const pProp, const int a, const int b)
+{
+	if (IsReachable(pProp, a) != IsReachable(pProp, b)) { return false; }
+	if (!IsReachable(pProp, a)) { return true; }
+	const struct PropValue* const pA = GetState(pProp, a);
+	const struct PropValue* const pB = GetState(pProp, b);
+	for (int i = 0; i < pProp->lvarCount; ++i)
+	{
+		if (!IsSameValue(&pA[i], &pB[i])) { return false; }
+	}
+	return true;
+}
+// 合流: 両方から来うるので，一致しない変数は不明にする
+static void JoinState(const struct Propagator* const pProp, const int dst, const int src)
+{
+	if (!IsReachable(pProp, src)) { return; }
+	if (!IsReachable(pProp, dst)) { CopyState(pProp, dst, src); return; }
+	struct PropValue* const pDst = GetState(pProp, dst);
+	const struct PropValue* const pSrc = GetState(pProp, src);
+	for (int i = 0; i < pProp->lvarCount; ++i)
+	{
+		if (!IsSameValue(&pDst[i], &pSrc[i])) { pDst[i].kind = PV_VARYING; }
+	}
+}
+
+// -- EXPRESSION --
+static struct PropValue MakeValue(const enum PropKind kind, const long long value, struct LocalVar* const pCopy)
+{
+	struct PropValue result;
+	result.kind = kind;
+	result.hasSideEffect = 0;
+	result.value = value;
+	result.pCopy = pCopy;
+	return result;
+}
+// 変数の今の値(不明ならその変数自身の写し)
+static struct PropValue ReadLocalVar(const struct Propagator* const pProp, const int state, struct LocalVar* const pLVar)
+{
+	const struct PropValue value = GetState(pProp, state)[pLVar->index];
+	if (value.kind == PV_VARYING) { return MakeValue(PV_COPY, 0, pLVar); }
+	return value;
+}
+// 代入後の変数の値を記録して式の値を返す
+static struct PropValue AssignLocalVar(const struct Propagator* const pProp, const int state, struct LocalVar* const pLVar, const struct PropValue value)
+{
+	struct PropValue* const pValues = GetState(pProp, state);
+	struct PropValue stored = MakeValue(PV_VARYING, 0, NULL);
+	if (value.kind == PV_COPY && value.pCopy == pLVar)
+	{
+		// x = x は値を変えない
+		stored = pValues[pLVar->index];
+	}
+	else
+	{
+		// 書き換える変数を写していた変数は写しでなくなる
+		for (int i = 0; i < pProp->lvarCount; ++i)
+		{
+			if (pValues[i].kind == PV_COPY && pValues[i].pCopy == pLVar) { pValues[i].kind = PV_VARYING; }
+		}
+		// intへの代入は32bitに切り詰める(8Byteの変数からの写しは値が変わりうる)
+		if (value.kind == PV_CONST) { stored = MakeValue(PV_CONST, (pLVar->size == 4) ? (int)value.value : value.value, NULL); }
+		if (value.kind == PV_COPY && pLVar->size >= value.pCopy->size) { stored = value; }
+		pValues[pLVar->index] = stored;
+	}
+
+	struct PropValue result = (stored.kind == PV_VARYING) ? MakeValue(PV_COPY, 0, pLVar) : stored;
+	result.hasSideEffect = 1;
+	return result;
+}
+// 両辺が定数の二項演算(生成コードと同じく64bitで計算する)
+static struct PropValue FoldBinary(const enum NodeKind kind, const struct PropValue lhs, const struct PropValue rhs)
+{
+	struct PropValue result = MakeValue(PV_VARYING, 0, NULL);
+	result.hasSideEffect = lhs.hasSideEffect || rhs.hasSideEffect;
+	if (lhs.kind != PV_CONST || rhs.kind != PV_CONST) { return result; }
+
+	const unsigned long long a = (unsigned long long)lhs.value;
+	const unsigned long long b = (unsigned long long)rhs.value;
+	result.kind = PV_CONST;
+	switch(kind)
+	{
+		case ND_ADD: result.value = (long long)(a + b); break;
+		case ND_SUB: result.value = (long long)(a - b); break;
+		case ND_MUL: result.value = (long long)(a * b); break;
+		case ND_DIV:
+			// 実行時に例外になる除算は残す
+			if (rhs.value == 0 || (lhs.value == LLONG_MIN && rhs.value == -1)) { result.kind = PV_VARYING; break; }
+			result.value = lhs.value / rhs.value;
+			break;
+		case ND_EQU: result.value = (lhs.value == rhs.value); break;
+		case ND_NEQ: result.value = (lhs.value != rhs.value); break;
+		case ND_LTH: result.value = (lhs.value < rhs.value); break;
+		case ND_LEQ: result.value = (lhs.value <= rhs.value); break;
+		default: result.kind = PV_VARYING; break;
+	}
+	return result;
+}
+// pushの即値(符号付き32bit)で表せる定数
+static bool IsImmediate(const struct PropValue value)
+{
+	return (value.kind == PV_CONST && INT_MIN <= value.value && value.value <= INT_MAX);
+}
+static void RewriteRead(const struct Propagator* const pProp, struct Node* const pNode, const struct PropValue value)
+{
+	if (!pProp->isRewrite) { return; }
+	if (IsImmediate(value))
+	{
+		SetNode(&(*pNode), ND_NUM, NULL, NULL, (int)value.value);
+		pNode->pLVar = NULL;
+		++pProp->pCtx->stats.ccpUseCount;
+	}
+	else if (value.kind == PV_COPY && value.pCopy != pNode->pLVar)
+	{
+		pNode->pLVar = value.pCopy;
+		++pProp->pCtx->stats.ccpUseCount;
+	}
+}
+static void RewriteFold(const struct Propagator* const pProp, struct Node* const pNode, const struct PropValue value)
+{
+	if (!pProp->isRewrite || value.hasSideEffect || !IsImmediate(value)) { return; }
+	SetNode(&(*pNode), ND_NUM, NULL, NULL, (int)value.value);
+	++pProp->pCtx->stats.ccpFoldCount;
+}
+// 式を評価順(左から)にたどって値を求め，代入を状態に反映する
+// if変換より前に行うのでND_SELECTは現れない
+static struct PropValue EvalExpr(const struct Propagator* const pProp, const int state, struct Node* const pRoot)
+{
+	struct MccContext* const pCtx = pProp->pCtx;
+	int size = 0;
+	int operandSize = 0;
+	struct GenWork* pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, 1, sizeof(struct GenWork));
+	struct PropValue* pOperands = (struct PropValue*)ReserveBuffer(&pCtx->propOperands, 1, sizeof(struct PropValue));
+	pWorks[size].pNode = pRoot;
+	pWorks[size++].phase = 0;
+
+	while(size > 0)
+	{
+		const struct GenWork work = pWorks[--size];
+		struct Node* const pCur = (struct Node*)work.pNode;
+		struct PropValue value = MakeValue(PV_VARYING, 0, NULL);
+		if (work.phase == 0)
+		{
+			switch(pCur->kind)
+			{
+				case ND_NUM:
+					value = MakeValue(PV_CONST, pCur->value, NULL);
+					break;
+				case ND_LVAR:
+					value = ReadLocalVar(pProp, state, pCur->pLVar);
+					RewriteRead(pProp, pCur, value);
+					break;
+				case ND_FUNC:
+					// 関数から変数は見えない
+					value.hasSideEffect = 1;
+					break;
+				default:
+					// 子を評価してから戻る(代入の左辺は読まない)
+					pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, size + 3, sizeof(struct GenWork));
+					pWorks[size].pNode = pCur;
+					pWorks[size++].phase = 1;
+					pWorks[size].pNode = pCur->pRhs;
+					pWorks[size++].phase = 0;
+					if (pCur->kind != ND_ASSIGN)
+					{
+						pWorks[size].pNode = pCur->pLhs;
+						pWorks[size++].phase = 0;
+					}
+					continue;
+			}
+		}
+		else if (pCur->kind == ND_ASSIGN)
+		{
+			const struct PropValue rhs = pOperands[--operandSize];
+			if (pCur->pLhs->kind == ND_LVAR) { value = AssignLocalVar(pProp, state, pCur->pLhs->pLVar, rhs); }
+			else                             { value.hasSideEffect = 1; } // コード生成でエラーになる
+		}
+		else
+		{
+			const struct PropValue rhs = pOperands[--operandSize];
+			const struct PropValue lhs = pOperands[--operandSize];
+			value = FoldBinary(pCur->kind, lhs, rhs);
+			RewriteFold(pProp, pCur, value);
+		}
+
+		pOperands = (struct PropValue*)ReserveBuffer(&pCtx->propOperands, operandSize + 1, sizeof(struct PropValue));
+		pOperands[operandSize++] = value;
+	}
+	assert(operandSize == 1);
+	return pOperands[0];
+}
+
+// -- STATEMENT --
+// 通らないことが分かった文をその文の値(0)だけを残したブロックにする
+static void PruneStmt(const struct Propagator* const pProp, struct Node* const pNode, struct Node* const pRest)
+{
+	SetNode(&(*pNode), ND_BLOCK, NULL, NULL, 0);
+	pNode->pBlock = pRest;
+	pNode->pCond = NULL;
+	pNode->pThen = NULL;
+	pNode->pElse = NULL;
+	++pProp->pCtx->stats.ccpBranchCount;
+}
+static void PropagateStmt(struct Propagator* const pProp, const int state, struct Node* const pNode);
+static void PropagateIf(struct Propagator* const pProp, const int state, struct Node* const pNode)
+{
+	const struct PropValue cond = EvalExpr(pProp, state, pNode->pCond);
+	if (cond.kind == PV_CONST)
+	{
+		struct Node* const pArm = (cond.value != 0) ? pNode->pThen : pNode->pElse;
+		if (pArm != NULL) { PropagateStmt(pProp, state, pArm); }
+		// 腕が空のときの文の値(rax)は条件の値なので，畳み込んだ条件を腕の前に残す
+		if (pProp->isRewrite && !cond.hasSideEffect)
+		{
+			pNode->pCond->pNext = pArm;
+			PruneStmt(pProp, pNode, pNode->pCond);
+		}
+		return;
+	}
+
+	const int elseState = PushState(pProp);
+	CopyState(pProp, elseState, state);
+	PropagateStmt(pProp, state, pNode->pThen);
+	if (pNode->pElse != NULL) { PropagateStmt(pProp, elseState, pNode->pElse); }
+	JoinState(pProp, state, elseState);
+	PopStates(pProp, 1);
+}
+// headから1周分を解析する: workは本体の終わり，exitはループの出口
+static struct PropValue PropagateLoopOnce(struct Propagator* const pProp, const int head, const int work, const int exit, struct Node* const pNode)
+{
+	CopyState(pProp, work, head);
+	const struct PropValue cond = EvalExpr(pProp, work, pNode->pCond);
+	const bool isAlwaysTrue = (cond.kind == PV_CONST && cond.value != 0);
+	const bool isAlwaysFalse = (cond.kind == PV_CONST && cond.value == 0);
+	if (isAlwaysTrue) { SetReachable(pProp, exit, false); }
+	else              { CopyState(pProp, exit, work); }
+	if (isAlwaysFalse)
+	{
+		SetReachable(pProp, work, false);
+		return cond;
+	}
+
+	const int outerBreakState = pProp->breakState;
+	pProp->breakState = exit;
+	PropagateStmt(pProp, work, pNode->pThen);
+	pProp->breakState = outerBreakState;
+	return cond;
+}
+static void PropagateWhile(struct Propagator* const pProp, const int state, struct Node* const pNode)
+{
+	const int head = PushState(pProp);
+	const int work = PushState(pProp);
+	const int exit = PushState(pProp);
+	CopyState(pProp, head, state);
+
+	// 先頭の状態が変わらなくなるまで書き換えずに解析する
+	// 変わるたびにどれかの変数が不明になるので変数の数+1回で止まる
+	const bool isRewrite = pProp->isRewrite;
+	pProp->isRewrite = false;
+	for (int i = 0; ; ++i)
+	{
+		PropagateLoopOnce(pProp, head, work, exit, pNode);
+		JoinState(pProp, work, state);
+		if (IsSameState(pProp, work, head)) { break; }
+		CopyState(pProp, head, work);
+		if (i > pProp->lvarCount) { SetVarying(pProp, head); }
+	}
+	pProp->isRewrite = isRewrite;
+
+	if (isRewrite)
+	{
+		const struct PropValue cond = PropagateLoopOnce(pProp, head, work, exit, pNode);
+		if (cond.kind == PV_CONST && cond.value == 0 && !cond.hasSideEffect) { PruneStmt(pProp, pNode, pNode->pCond); }
+	}
+	CopyState(pProp, state, exit);
+	PopStates(pProp, 3);
+}
+static void PropagateSwitch(struct Propagator* const pProp, const int state, struct Node* const pNode)
+{
+	EvalExpr(pProp, state, pNode->pCond);
+	const int entry = PushState(pProp);
+	const int exit = PushState(pProp);
+	CopyState(pProp, entry, state);
+	if (pNode->pDefault == NULL) { CopyState(pProp, exit, state); }
+
+	// 本体へはcaseからだけ入る
+	const int outerBreakState = pProp->breakState;
+	const int outerSwitchState = pProp->switchState;
+	pProp->breakState = exit;
+	pProp->switchState = entry;
+	SetReachable(pProp, state, false);
+	PropagateStmt(pProp, state, pNode->pThen);
+	pProp->breakState = outerBreakState;
+	pProp->switchState = outerSwitchState;
+
+	JoinState(pProp, exit, state);
+	CopyState(pProp, state, exit);
+	PopStates(pProp, 2);
+}
+static void PropagateStmt(struct Propagator* const pProp, const int state, struct Node* const pNode)
+{
+	// ブロックとcaseは途中から入りうるので到達しなくてもたどる
+	switch(pNode->kind)
+	{
+		case ND_BLOCK:
+			for (struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext) { PropagateStmt(pProp, state, pTmp); }
+			return;
+		case ND_CASE:
+		case ND_DEFAULT:
+			JoinState(pProp, state, pProp->switchState);
+			PropagateStmt(pProp, state, pNode->pThen);
+			return;
+		default:
+			break;
+	}
+	if (!IsReachable(pProp, state)) { return; }
+
+	switch(pNode->kind)
+	{
+		case ND_RTN:
+			EvalExpr(pProp, state, pNode->pLhs);
+			SetReachable(pProp, state, false);
+			return;
+		case ND_BREAK:
+			assert(pProp->breakState >= 0);
+			JoinState(pProp, pProp->breakState, state);
+			SetReachable(pProp, state, false);
+			return;
+		case ND_IF:
+			PropagateIf(pProp, state, pNode);
+			return;
+		case ND_WHILE:
+			PropagateWhile(pProp, state, pNode);
+			return;
+		case ND_SWITCH:
+			PropagateSwitch(pProp, state, pNode);
+			return;
+		default:
+			EvalExpr(pProp, state, pNode);
+			return;
+	}
+}
+
+// caseがswitchの本体の直下(ブロックとcaseの入れ子は可)にだけあるか
+static bool IsStructured(const struct Node* const pNode, const bool isCaseAllowed)
+{
+	if (pNode == NULL) { return true; }
+	switch(pNode->kind)
+	{
+		case ND_BLOCK:
+			for (const struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext)
+			{
+				if (!IsStructured(pTmp, isCaseAllowed)) { return false; }
+			}
+			return true;
+		case ND_CASE:
+		case ND_DEFAULT:
+			return isCaseAllowed && IsStructured(pNode->pThen, true);
+		case ND_SWITCH:
+			return IsStructured(pNode->pThen, true);
+		case ND_IF:
+			return IsStructured(pNode->pThen, false) && IsStructured(pNode->pElse, false);
+		case ND_WHILE:
+			return IsStructured(pNode->pThen, false);
+		default:
+			return true;
+	}
+}
+void PropagateConstants(struct MccContext* const pCtx, struct Node* const pProgram)
+{
+	for (const struct Node* pCode = pProgram; pCode != NULL; pCode = pCode->pNext)
+	{
+		if (!IsStructured(pCode, false)) { return; }
+	}
+
+	struct Propagator prop;
+	prop.pCtx = pCtx;
+	prop.lvarCount = pCtx->lvarMemoryCount;
+	prop.stateSize = 0;
+	prop.breakState = -1;
+	prop.switchState = -1;
+	prop.isRewrite = true;
+
+	const int state = PushState(&prop);
+	SetVarying(&prop, state);
+	SetReachable(&prop, state, true);
+	for (struct Node* pCode = pProgram; pCode != NULL; pCode = pCode->pNext) { PropagateStmt(&prop, state, pCode); }
+}
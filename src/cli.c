@@ -0,0 +1,147 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// "-f..." はオプション，それ以外は 入力 [token|node|memory|stats] の順
+static bool ParseOption(struct Option* const pOption, const char* const pArg)
+{
+	if (strncmp(pArg, "-fprofile-generate", 18) == 0)
+	{
+		pOption->isProfileGenerate = true;
+		if (pArg[18] == '=') { pOption->pProfilePath = &pArg[19]; }
+		return (pArg[18] == '\0' || pArg[18] == '=');
+	}
+	if (strncmp(pArg, "-fprofile-use", 13) == 0)
+	{
+		pOption->isProfileUse = true;
+		if (pArg[13] == '=') { pOption->pProfilePath = &pArg[14]; }
+		return (pArg[13] == '\0' || pArg[13] == '=');
+	}
+	if (strcmp(pArg, "-fcse") == 0) { pOption->isCse = true; return true; }
+	if (strcmp(pArg, "-fno-cse") == 0) { pOption->isCse = false; return true; }
+	if (strcmp(pArg, "-fccp") == 0) { pOption->isCcp = true; return true; }
+	if (strcmp(pArg, "-fno-ccp") == 0) { pOption->isCcp = false; return true; }
+	if (strcmp(pArg, "-fstack-reuse=all") == 0) { pOption->isStackReuse = true; return true; }
+	if (strcmp(pArg, "-fstack-reuse=none") == 0) { pOption->isStackReuse = false; return true; }
+	if (strcmp(pArg, "-fscan=scalar") == 0) { pOption->scanLevel = SCAN_SCALAR; return true; }
+	if (strcmp(pArg, "-fscan=sse2") == 0) { pOption->scanLevel = SCAN_SSE2; return true; }
+	if (strcmp(pArg, "-fscan=avx2") == 0) { pOption->scanLevel = SCAN_AVX2; return true; }
+	if (strcmp(pArg, "-fno-unroll-loops") == 0) { pOption->unrollFactor = 1; return true; }
+	if (strncmp(pArg, "-funroll-loops=", 15) == 0)
+	{
+		char* pEnd = NULL;
+		const long factor = strtol(&pArg[15], &pEnd, 10);
+		if (pEnd == &pArg[15] || *pEnd != '\0' || factor < 1 || factor > 16) { return false; }
+		pOption->unrollFactor = (int)factor;
+		return true;
+	}
+	if (strcmp(pArg, "-fisel") == 0) { pOption->isIsel = true; return true; }
+	if (strcmp(pArg, "-fno-isel") == 0) { pOption->isIsel = false; return true; }
+	if (strcmp(pArg, "-fif-conversion") == 0) { pOption->isIfConversion = true; return true; }
+	if (strcmp(pArg, "-fno-if-conversion") == 0) { pOption->isIfConversion = false; return true; }
+	if (strcmp(pArg, "-fomit-frame-pointer") == 0) { pOption->isOmitFramePointer = true; return true; }
+	if (strcmp(pArg, "-fno-omit-frame-pointer") == 0) { pOption->isOmitFramePointer = false; return true; }
+	if (strcmp(pArg, "-frotate-loops") == 0) { pOption->isRotateLoops = true; return true; }
+	if (strcmp(pArg, "-fno-rotate-loops") == 0) { pOption->isRotateLoops = false; return true; }
+	if (strncmp(pArg, "-falign-loops=", 14) == 0)
+	{
+		// 1から4096までの2の冪
+		char* pEnd = NULL;
+		const long align = strtol(&pArg[14], &pEnd, 10);
+		if (pEnd == &pArg[14] || *pEnd != '\0' || align < 1 || align > 4096 || (align & (align - 1)) != 0) { return false; }
+		pOption->loopAlign = (int)align;
+		return true;
+	}
+	return false;
+}
+
+// コマンドライン1回分を実行して終了コードを返す(argvはプログラム名を含まない)
+// pWorkDirはサーバ経由のときの呼び出し側のカレントディレクトリ(NULLなら自分)
+int RunCommand(struct MccContext* const pCtx, const char* const pWorkDir, const int argc, char* argv[], FILE* const pStdout, FILE* const pStderr)
+{
+	mcc_init_option(&pCtx->option);
+
+	char* userInput = NULL;
+	const char* pDebugMode = "";
+	for (int i = 0; i < argc; ++i)
+	{
+		if (argv[i][0] == '-' && argv[i][1] == 'f')
+		{
+			if (!ParseOption(&pCtx->option, argv[i])) { fprintf(pStderr, "Unknown option: %s\n", argv[i]); return 1; }
+		}
+		else if (userInput == NULL) { userInput = argv[i]; }
+		else { pDebugMode = argv[i]; }
+	}
+	if (userInput == NULL)
+	{
+		fprintf(pStderr, "This program requires more than two arguments(argc=%d).\n", argc + 1);
+		return 1;
+	}
+
+	// 読み込むプロファイルは呼び出し側から見た位置にする(書き出す位置は生成したプログラムの実行時に決まる)
+	char profilePath[4096];
+	if (pWorkDir != NULL && pCtx->option.isProfileUse && pCtx->option.pProfilePath[0] != '/')
+	{
+		snprintf(profilePath, sizeof(profilePath), "%s/%s", pWorkDir, pCtx->option.pProfilePath);
+		pCtx->option.pProfilePath = profilePath;
+	}
+	// 読めないプロファイルは警告だけしてプロファイルなしでコンパイルする(mcc_compileはエラーにする)
+	if (pCtx->option.isProfileUse)
+	{
+		FILE* const pFile = fopen(pCtx->option.pProfilePath, "r");
+		if (pFile == NULL)
+		{
+			fprintf(pStderr, "Cannot read profile: %s\n", pCtx->option.pProfilePath);
+			pCtx->option.isProfileUse = false;
+		}
+		else
+		{
+			fclose(pFile);
+		}
+	}
+
+	struct OutBuffer out;
+	mcc_init_out_buffer(&out);
+	if (mcc_compile(pCtx, userInput, strlen(userInput), &out) != MCC_OK)
+	{
+		fprintf(pStderr, "%s\n", mcc_error_message(pCtx));
+		mcc_release_out_buffer(&out);
+		return 1;
+	}
+
+	if (strncmp(pDebugMode, "token", 5) == 0) { fprintf(pStdout, "\ntest token\n"); DebugPrintTokens(pStdout, pCtx->pTokens); }
+	if (strncmp(pDebugMode, "node", 4) == 0) { fprintf(pStdout, "\ntest node\n"); for (const struct Node* pCode = pCtx->pProgram; pCode != NULL; pCode = pCode->pNext) { DebugPrintNodes(pStdout, pCode); } }
+
+	fwrite(out.pData, 1, out.size, pStdout);
+
+	if (strncmp(pDebugMode, "memory", 6) == 0)
+	{
+		fprintf(pStdout, "token: %d\n", pCtx->tokenMemoryCount);
+		fprintf(pStdout, "node: %d\n", pCtx->nodeMemoryCount);
+		fprintf(pStdout, "lvar: %d\n", pCtx->lvarMemoryCount);
+		fprintf(pStdout, "arena: %zu\n", pCtx->arena.allocSize);
+	}
+	// 統計はアセンブリを壊さないよう標準エラーへ出す
+	if (strncmp(pDebugMode, "stats", 5) == 0)
+	{
+		const struct Stats* const pStats = &pCtx->stats;
+		fprintf(pStderr, "frame: %d bytes (%d locals in %d slots, %d bytes without typed slots and reuse)\n", pStats->frameSize, pStats->lvarCount, pStats->slotCount, pStats->legacyFrameSize);
+		static const char* const frameKinds[] = {"rbp", "rsp", "red zone"};
+		fprintf(pStderr, "locals: addressed from %s\n", frameKinds[pCtx->frameKind]);
+		fprintf(pStderr, "ccp: %d uses replaced, %d expressions folded, %d branches removed\n", pStats->ccpUseCount, pStats->ccpFoldCount, pStats->ccpBranchCount);
+		fprintf(pStderr, "cse: %d expressions eliminated\n", pStats->cseCount);
+		fprintf(pStderr, "unroll: %d loops unrolled (%d fully)\n", pStats->unrollCount, pStats->fullUnrollCount);
+		fprintf(pStderr, "ifconv: %d branches removed\n", pStats->ifConversionCount);
+	}
+
+	mcc_release_out_buffer(&out);
+	return 0;
+}
@@ -0,0 +1,46 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mcc.h"
+
+// mcc_client: mccと同じ引数をコンパイルサーバへ送り，出力と終了コードをそのまま返す
+// サーバは mcc --server で起動しておく(位置は環境変数 MCC_SOCKET で変えられる)
+int main(int argc, char *argv[])
+{
+	char path[MCC_SOCKET_PATH_MAX];
+	GetSocketPath(path, sizeof(path));
+	const int fd = ConnectServer(path);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Cannot connect to mcc server at %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	char workDir[4096];
+	if (getcwd(workDir, sizeof(workDir)) == NULL) { workDir[0] = '\0'; }
+
+	// コンパイラ本体をリンクしないようにライブラリ関数は使わない
+	struct OutBuffer out = {NULL, 0, 0};
+	struct OutBuffer err = {NULL, 0, 0};
+	int status = 1;
+	if (!SendRequest(fd, workDir, argc - 1, &argv[1]) || !ReceiveResponse(fd, &status, &out, &err))
+	{
+		fprintf(stderr, "Lost connection to mcc server at %s\n", path);
+		close(fd);
+		return 1;
+	}
+	close(fd);
+
+	fwrite(out.pData, 1, out.size, stdout);
+	fwrite(err.pData, 1, err.size, stderr);
+	free(out.pData);
+	free(err.pData);
+	return status;
+}
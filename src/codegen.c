@@ -10,161 +10,1205 @@
 
 #include "mcc.h"
 
-void GenLval(const struct Node* const pNode)
+// switchの分岐方法の閾値
+#define SWITCH_LINEAR_MAX 3    // case数がこれ以下なら線形に比較する
+#define SWITCH_TABLE_DENSITY 3 // 値の範囲がcase数のこの倍以下ならジャンプテーブル
+#define SWITCH_TABLE_MAX 4096  // ジャンプテーブルの最大要素数
+
+// プロファイルによる配置の閾値
+#define PROFILE_COLD_RATIO 8 // 片方の腕がもう片方のこの分の1以下なら関数の後ろへ追い出す
+#define PROFILE_HOT_TRIP 16  // 平均反復回数がこれ未満のループは先頭を揃えない
+
+// -- LABEL --
+static bool IsExprNode(const struct Node* const pNode)
 {
-	if (pNode->kind != ND_LVAR)
+	switch(pNode->kind)
+	{
+		case ND_RTN: case ND_IF: case ND_WHILE: case ND_BLOCK:
+		case ND_SWITCH: case ND_CASE: case ND_DEFAULT: case ND_BREAK:
+			return false;
+		default:
+			return true;
+	}
+}
+// 比較の結果を分岐やcmovの条件にするときは比較の両辺を直接積む
+static bool IsFusedCompare(const struct Node* const pNode)
+{
+	switch(pNode->kind)
+	{
+		case ND_EQU: case ND_NEQ: case ND_LTH: case ND_LEQ:
+			return true;
+		default:
+			return false;
+	}
+}
+// 条件(比較なら両辺)，真の値，偽の値の順に積む
+static void LabelSelectNode(struct Node* const pNode)
+{
+	const struct Node* const pCond = pNode->pCond;
+	int operands[4];
+	int size = 0;
+	if (IsFusedCompare(pCond))
+	{
+		operands[size++] = pCond->pLhs->suLabel;
+		operands[size++] = pCond->pRhs->suLabel;
+	}
+	else
 	{
-		fprintf(stderr, "Left is not varialble.\n");
-		exit(1);
+		operands[size++] = pCond->suLabel;
 	}
+	operands[size++] = pNode->pLhs->suLabel;
+	operands[size++] = pNode->pRhs->suLabel;
 
-	printf("  mov rax, rbp\n");
-	printf("  sub rax, %d\n", pNode->offset);
-	printf("  push rax\n");
+	pNode->suLabel = 0;
+	for (int i = 0; i < size; ++i)
+	{
+		if (operands[i] + i > pNode->suLabel) { pNode->suLabel = operands[i] + i; }
+	}
+	pNode->hasSideEffect = pCond->hasSideEffect || pNode->pLhs->hasSideEffect || pNode->pRhs->hasSideEffect;
+	pNode->isRhsFirst = 0;
 }
+// 式ノードのSethi-Ullman数を後行順で付ける
+// 値はそのノードの評価に必要なスタック段数
+static void LabelExprNode(struct Node* const pNode)
+{
+	switch(pNode->kind)
+	{
+		case ND_NUM:
+		case ND_LVAR:
+			pNode->suLabel = 1;
+			pNode->hasSideEffect = 0;
+			pNode->isRhsFirst = 0;
+			return;
+		case ND_FUNC:
+			pNode->suLabel = 1;
+			pNode->hasSideEffect = 1;
+			pNode->isRhsFirst = 0;
+			return;
+		case ND_SELECT:
+			LabelSelectNode(pNode);
+			return;
+		default:
+			break;
+	}
+
+	const struct Node* const pLhs = pNode->pLhs;
+	const struct Node* const pRhs = pNode->pRhs;
+	assert(pLhs != NULL && pRhs != NULL);
+
+	// 左辺のアドレス計算は副作用がないので代入は常に入れ替えてよい
+	// それ以外は両辺とも副作用がない場合だけ評価順を入れ替える
+	const bool isSwappable = (pNode->kind == ND_ASSIGN) || (!pLhs->hasSideEffect && !pRhs->hasSideEffect);
+	pNode->isRhsFirst = (isSwappable && pRhs->suLabel > pLhs->suLabel) ? 1 : 0;
 
-// スタックマシン
-void Gen(const struct Node* const pNode)
+	const int first = pNode->isRhsFirst ? pRhs->suLabel : pLhs->suLabel;
+	const int second = pNode->isRhsFirst ? pLhs->suLabel : pRhs->suLabel;
+	pNode->suLabel = (first > second + 1) ? first : second + 1;
+	pNode->hasSideEffect = (pNode->kind == ND_ASSIGN) || pLhs->hasSideEffect || pRhs->hasSideEffect;
+}
+// 木全体を明示的なスタックで後行順に走査してラベル付けする
+void LabelNodes(struct MccContext* const pCtx, struct Node* const pRootNode)
 {
-	assert(pNode != NULL);
+	if (pRootNode == NULL) { return; }
 
-	static int jumpIndex = 0;
+	// 最後の文がreturnなら，途中の文の値(rax)が戻り値として残ることはない
+	const struct Node* pLast = pRootNode;
+	while(pLast->pNext != NULL) { pLast = pLast->pNext; }
+	pCtx->isStmtValueUsed = (pLast->kind != ND_RTN);
 
-	switch(pNode->kind)
+	int size = 0;
+	struct Node** pNodes = (struct Node**)ReserveBuffer(&pCtx->labelNodes, 64, sizeof(struct Node*));
+	int* pVisited = (int*)ReserveBuffer(&pCtx->labelVisited, 64, sizeof(int));
+
+	pNodes[size] = pRootNode;
+	pVisited[size++] = 0;
+	while(size > 0)
 	{
-		case ND_RTN:
-			Gen(pNode->pLhs);
-			printf("  pop rax\n");
-			printf("  mov rsp, rbp\n");
-			printf("  pop rbp\n");
-			printf("  ret\n");
-			return;
-		case ND_IF: // if(A) B else C
+		struct Node* const pNode = pNodes[size - 1];
+		if (pVisited[size - 1])
 		{
-			int cnt = jumpIndex++;
-			Gen(pNode->pCond); // A
-			printf("  pop rax\n");
-			printf("  cmp rax, 0\n");
-			if (pNode->pElse == NULL) // if文単体
-			{
-				printf("  je .Lend%d\n", cnt);
-				Gen(pNode->pThen); // B
-			}
-			else // if-else
+			--size;
+			if (IsExprNode(pNode))
 			{
-				printf("  je .Lelse%d\n", cnt);
-				Gen(pNode->pThen); // B
-				printf("  jmp .Lend%d\n", cnt);
-				printf(".Lelse%d:\n", cnt);
-				Gen(pNode->pElse); // C
+				LabelExprNode(pNode);
+				if (pNode->suLabel > pCtx->exprDepth) { pCtx->exprDepth = pNode->suLabel; }
+				if (pNode->kind == ND_FUNC) { pCtx->hasCall = true; }
 			}
-			printf(".Lend%d:\n", cnt);
-			return;
+			continue;
 		}
-		case ND_WHILE:
-		{
-			int cnt = jumpIndex++;
-			printf(".Lbegin%d:\n", cnt);
-			Gen(pNode->pCond);
-			printf("  pop rax\n");
-			printf("  cmp rax, 0\n");
-			printf("  je .Lend%d\n", cnt);
-			Gen(pNode->pThen);
-			printf("  jmp .Lbegin%d\n", cnt);
-			printf(".Lend%d:\n", cnt);
-			return;
-		}
-		case ND_BLOCK:
-			for (struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pBlock)
-			{
-				if (pTmp->isReadBlock == 0)
-				{
-					// 読み込んだブロックとして登録して，読み込み済みはスキップする
-					pTmp->isReadBlock = 1;
-					Gen(pTmp);
-				}
-			}
-			return;
-		case ND_FUNC:
+		pVisited[size - 1] = 1;
+
+		struct Node* const children[] = {pNode->pBlock, pNode->pNext, pNode->pCond, pNode->pThen, pNode->pElse, pNode->pLhs, pNode->pRhs};
+		for (int i = 0; i < (int)(sizeof(children)/sizeof(children[0])); ++i)
 		{
-			assert(pNode->pLabel != NULL);
-			char tmp[100] = {};
-			assert(sizeof(tmp)/sizeof(tmp[0]) > pNode->labelLen);
-			strncpy(tmp, pNode->pLabel, pNode->labelLen);
-			tmp[pNode->labelLen] = '\0';
-			printf("  call %s\n", tmp);
+			if (children[i] == NULL) { continue; }
+			pNodes = (struct Node**)ReserveBuffer(&pCtx->labelNodes, size + 1, sizeof(struct Node*));
+			pVisited = (int*)ReserveBuffer(&pCtx->labelVisited, size + 1, sizeof(int));
+			pNodes[size] = children[i];
+			pVisited[size++] = 0;
 		}
-			return;
 	}
+}
 
-	switch (pNode->kind)
+// -- CODE GENERATOR --
+static void CountPush(struct MccContext* const pCtx)
+{
+	++pCtx->stackDepth;
+	// レッドゾーンでは積んだ値が変数の領域に届いてはいけない
+	assert(pCtx->frameKind != FRAME_RED_ZONE || pCtx->stackDepth <= pCtx->exprDepth);
+}
+static void EmitPush(struct MccContext* const pCtx, const char* const reg)
+{
+	Emit(pCtx, "  push %s\n", reg);
+	CountPush(pCtx);
+}
+static void EmitPop(struct MccContext* const pCtx, const char* const reg)
+{
+	Emit(pCtx, "  pop %s\n", reg);
+	--pCtx->stackDepth;
+	assert(pCtx->stackDepth >= 0);
+}
+
+void GenLval(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	if (pNode->kind != ND_LVAR)
 	{
-		case ND_NUM:
-			printf("  push %d\n", pNode->value);
-			return;
-		case ND_LVAR:
-			GenLval(pNode);
-			printf("  pop rax\n");
-			printf("  mov rax, [rax]\n");
-			printf("  push rax\n");
-			return;
-		case ND_ASSIGN:
-			GenLval(pNode->pLhs);
-			Gen(pNode->pRhs);
+		Error(pCtx, "Left is not varialble.");
+	}
 
-			printf("  pop rdi\n");
-			printf("  pop rax\n");
-			printf("  mov [rax], rdi\n");
-			printf("  push rdi\n");
-			return;
+	if (pCtx->frameKind == FRAME_RBP)
+	{
+		Emit(pCtx, "  mov rax, rbp\n");
+		Emit(pCtx, "  sub rax, %d\n", pNode->pLVar->offset);
+	}
+	else
+	{
+		// 積んだ分だけrspが下がっている(レッドゾーンではrspより下を指す)
+		const int disp = 8 * pCtx->stackDepth + pCtx->frameTop - pNode->pLVar->offset;
+		Emit(pCtx, "  lea rax, [rsp %c %d]\n", (disp < 0) ? '-' : '+', abs(disp));
+	}
+	EmitPush(pCtx, "rax");
+}
+// mainの入口: 変数の指し方を決める(LabelNodesの後に呼ぶ)
+void GenPrologue(struct MccContext* const pCtx)
+{
+	if (!pCtx->option.isOmitFramePointer)
+	{
+		pCtx->frameKind = FRAME_RBP;
+		Emit(pCtx, "  push rbp\n");
+		Emit(pCtx, "  mov rbp, rsp\n");
+		if (pCtx->frameSize > 0) { Emit(pCtx, "  sub rsp, %d\n", pCtx->frameSize); }
+		return;
 	}
 
-	Gen(pNode->pLhs);
-	Gen(pNode->pRhs);
+	// 何も呼ばなければレッドゾーンは壊されない．式の評価で積む分の下に変数を置く
+	const bool isLeaf = !pCtx->hasCall && !pCtx->option.isProfileGenerate;
+	if (isLeaf && 8 * pCtx->exprDepth + pCtx->frameSize <= RED_ZONE_SIZE)
+	{
+		pCtx->frameKind = FRAME_RED_ZONE;
+		pCtx->frameTop = -8 * pCtx->exprDepth;
+		return;
+	}
+	// 戻り番地の8Byteと合わせてrspを16Byte境界にする(上端の8Byteは使わない)
+	pCtx->frameKind = FRAME_RSP;
+	pCtx->frameTop = pCtx->frameSize;
+	Emit(pCtx, "  sub rsp, %d\n", pCtx->frameSize + 8);
+}
+// mainの出口(戻り値はraxにある)
+void GenEpilogue(struct MccContext* const pCtx)
+{
+	switch(pCtx->frameKind)
+	{
+		case FRAME_RBP:
+			Emit(pCtx, "  mov rsp, rbp\n");
+			Emit(pCtx, "  pop rbp\n");
+			break;
+		case FRAME_RSP:
+			Emit(pCtx, "  add rsp, %d\n", 8 * pCtx->stackDepth + pCtx->frameSize + 8);
+			break;
+		default:
+			if (pCtx->stackDepth > 0) { Emit(pCtx, "  add rsp, %d\n", 8 * pCtx->stackDepth); }
+			break;
+	}
+	Emit(pCtx, "  ret\n");
+}
 
-	printf("  pop rdi\n");
-	printf("  pop rax\n");
+// 式の評価: 作業スタックで駆動し，Cの再帰を使わない
+// 1つの式ノードは結果をちょうど1つ置き場所(dest)へ置く
+// 命令選択: 葉(定数/変数)は即値/メモリオペランドとして親の命令に埋め込み，
+// 値を使う側が直後に受け取るなら積まずにraxで渡す(-fno-iselでは全て積む)
+enum GenPhase
+{
+	GP_EVAL,    // 子を積む
+	GP_APPLY,   // 子の評価後に演算する
+	GP_ADDRESS, // 左辺値のアドレスを積む
+};
+// 二項演算の敷き詰め方
+enum BinaryTile
+{
+	BT_STACK,    // 両辺を積む
+	BT_RHS_LEAF, // 左辺をraxに求め，右辺の葉をオペランドにする
+	BT_LHS_LEAF, // 右辺をraxに求め，左辺の葉をオペランドにする(両辺を入れ替えて比べる)
+	BT_REGISTER, // 先に求める側を積み，後の側をraxに求める
+};
+// 代入の敷き詰め方(左辺は常に変数)
+enum AssignTile
+{
+	AT_STACK,     // アドレスと値を積む
+	AT_IMMEDIATE, // mov [x], imm
+	AT_UPDATE,    // x = x + E, x - E: add/sub [x], E
+	AT_STORE,     // 値をraxに求めてmov [x], rax
+};
+struct GenWorkStack
+{
+	struct MccContext* pCtx;
+	struct GenWork* pData;
+	int size;
+};
+static void PushWork(struct GenWorkStack* const pStack, const struct Node* const pNode, const enum GenPhase phase, const enum GenDest dest)
+{
+	pStack->pData = (struct GenWork*)ReserveBuffer(&pStack->pCtx->genWorks, pStack->size + 1, sizeof(struct GenWork));
+	pStack->pData[pStack->size].pNode = pNode;
+	pStack->pData[pStack->size].phase = phase;
+	pStack->pData[pStack->size].dest = dest;
+	++pStack->size;
+}
+// raxにある結果を置き場所へ
+static void GenResult(struct MccContext* const pCtx, const enum GenDest dest)
+{
+	if (dest == GD_STACK) { EmitPush(pCtx, "rax"); }
+}
+
+// -- OPERAND --
+static bool IsLeafNode(const struct Node* const pNode)
+{
+	return (pNode->kind == ND_NUM || pNode->kind == ND_LVAR);
+}
+// 変数のメモリオペランド(rsp基準なら今積んでいる段数で変わるので命令を出す直前に作る)
+static void FormatLocal(const struct MccContext* const pCtx, const struct LocalVar* const pLVar, char* const pBuf, const size_t size)
+{
+	const char* const pPtr = (pLVar->size == 4) ? "dword ptr" : "qword ptr";
+	if (pCtx->frameKind == FRAME_RBP)
+	{
+		snprintf(pBuf, size, "%s [rbp - %d]", pPtr, pLVar->offset);
+		return;
+	}
+	const int disp = 8 * pCtx->stackDepth + pCtx->frameTop - pLVar->offset;
+	snprintf(pBuf, size, "%s [rsp %c %d]", pPtr, (disp < 0) ? '-' : '+', abs(disp));
+}
+// 葉の値をregへ読む(intは符号拡張する)
+static void GenLoadLeaf(struct MccContext* const pCtx, const struct Node* const pLeaf, const char* const reg)
+{
+	if (pLeaf->kind == ND_NUM)
+	{
+		Emit(pCtx, "  mov %s, %d\n", reg, pLeaf->value);
+		return;
+	}
+	char mem[64];
+	FormatLocal(pCtx, pLeaf->pLVar, mem, sizeof(mem));
+	Emit(pCtx, "  %s %s, %s\n", (pLeaf->pLVar->size == 4) ? "movsxd" : "mov", reg, mem);
+}
+// 葉をraxとの演算の右オペランドにする(intの変数は64bitのまま使えないのでrdiへ読む)
+static const char* GetLeafOperand(struct MccContext* const pCtx, const struct Node* const pLeaf, char* const pBuf, const size_t size)
+{
+	if (pLeaf->kind == ND_NUM)
+	{
+		snprintf(pBuf, size, "%d", pLeaf->value);
+		return pBuf;
+	}
+	if (pLeaf->pLVar->size == 4)
+	{
+		GenLoadLeaf(pCtx, pLeaf, "rdi");
+		return "rdi";
+	}
+	FormatLocal(pCtx, pLeaf->pLVar, pBuf, size);
+	return pBuf;
+}
+
+// -- TILE --
+static enum BinaryTile GetBinaryTile(const struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	if (!pCtx->option.isIsel) { return BT_STACK; }
+	// 葉のSethi-Ullman数は1なので右辺が葉なら左辺が先に評価される
+	if (IsLeafNode(pNode->pRhs)) { return BT_RHS_LEAF; }
+	// 左辺の変数を右辺の後に読むので，右辺が代入を含むなら読む順が変わる
+	if (pNode->pLhs->kind == ND_NUM || (IsLeafNode(pNode->pLhs) && !pNode->pRhs->hasSideEffect)) { return BT_LHS_LEAF; }
+	return BT_REGISTER;
+}
+// x = x + E, x = E + x, x = x - E のE(それ以外はNULL)
+static const struct Node* GetUpdateOperand(const struct Node* const pNode)
+{
+	const struct LocalVar* const pLVar = pNode->pLhs->pLVar;
+	const struct Node* const pValue = pNode->pRhs;
+	if (pValue->kind != ND_ADD && pValue->kind != ND_SUB) { return NULL; }
+
+	const struct Node* pOperand = NULL;
+	if (pValue->pLhs->kind == ND_LVAR && pValue->pLhs->pLVar == pLVar)
+	{
+		pOperand = pValue->pRhs;
+	}
+	else if (pValue->kind == ND_ADD && pValue->pRhs->kind == ND_LVAR && pValue->pRhs->pLVar == pLVar)
+	{
+		pOperand = pValue->pLhs;
+	}
+	// 変数はEの評価の後に読み書きするので，Eが代入を含むなら順序が変わる
+	if (pOperand == NULL || pOperand->hasSideEffect) { return NULL; }
+	return pOperand;
+}
+static enum AssignTile GetAssignTile(const struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	if (!pCtx->option.isIsel) { return AT_STACK; }
+	if (pNode->pRhs->kind == ND_NUM) { return AT_IMMEDIATE; }
+	if (GetUpdateOperand(pNode) != NULL) { return AT_UPDATE; }
+	return AT_STORE;
+}
+
+// 比較の条件コード(isSwapped: 両辺を入れ替えて比べた, isNegate: 偽になる条件)
+static const char* GetCondCode(const enum NodeKind kind, const bool isSwapped, const bool isNegate)
+{
+	switch(kind)
+	{
+		case ND_EQU: return isNegate ? "ne" : "e";
+		case ND_NEQ: return isNegate ? "e" : "ne";
+		case ND_LTH:
+			if (isSwapped) { return isNegate ? "le" : "g"; }
+			return isNegate ? "ge" : "l";
+		case ND_LEQ:
+			if (isSwapped) { return isNegate ? "l" : "ge"; }
+			return isNegate ? "g" : "le";
+		default:
+			return isNegate ? "e" : "ne"; // 比較でない条件は0と比べる
+	}
+}
+
+// -- EXPRESSION --
+static void GenCall(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	assert(pNode->pLabel != NULL);
+
+	// プロローグ後のrspは16Byte境界なので，積んだ段数が奇数なら揃える
+	const bool isAligned = (pCtx->stackDepth % 2 == 0);
+	if (!isAligned) { Emit(pCtx, "  sub rsp, 8\n"); }
+	Emit(pCtx, "  call %.*s\n", pNode->labelLen, pNode->pLabel);
+	if (!isAligned) { Emit(pCtx, "  add rsp, 8\n"); }
+}
+// 両辺を積んだ二項演算(-fno-isel)
+static void GenBinary(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	// 先に評価した方がスタックの奥にある
+	if (pNode->isRhsFirst)
+	{
+		EmitPop(pCtx, "rax");
+		EmitPop(pCtx, "rdi");
+	}
+	else
+	{
+		EmitPop(pCtx, "rdi");
+		EmitPop(pCtx, "rax");
+	}
 
 	switch(pNode->kind)
 	{
+		case ND_ASSIGN:
+			// intへの代入は式の値も32bitに切り詰める
+			if (pNode->pLhs->pLVar->size == 4)
+			{
+				Emit(pCtx, "  mov dword ptr [rax], edi\n");
+				Emit(pCtx, "  movsxd rdi, edi\n");
+			}
+			else
+			{
+				Emit(pCtx, "  mov [rax], rdi\n");
+			}
+			EmitPush(pCtx, "rdi");
+			return;
 		case ND_ADD:
-			printf("  add rax, rdi\n");
+			Emit(pCtx, "  add rax, rdi\n");
 			break;
 		case ND_SUB:
-			printf("  sub rax, rdi\n");
+			Emit(pCtx, "  sub rax, rdi\n");
 			break;
 		case ND_MUL:
-			printf("  imul rax, rdi\n");
+			Emit(pCtx, "  imul rax, rdi\n");
 			break;
 		case ND_DIV:
-			printf("  cqo\n");
-			printf("  idiv rdi\n");
+			Emit(pCtx, "  cqo\n");
+			Emit(pCtx, "  idiv rdi\n");
 			break;
 		case ND_EQU:
-			printf("  cmp rax, rdi\n");
-			printf("  sete al\n");
-			printf("  movzb rax, al\n");
+			Emit(pCtx, "  cmp rax, rdi\n");
+			Emit(pCtx, "  sete al\n");
+			Emit(pCtx, "  movzb rax, al\n");
 			break;
 		case ND_NEQ:
-			printf("  cmp rax, rdi\n");
-			printf("  setne al\n");
-			printf("  movzb rax, al\n");
+			Emit(pCtx, "  cmp rax, rdi\n");
+			Emit(pCtx, "  setne al\n");
+			Emit(pCtx, "  movzb rax, al\n");
 			break;
 		case ND_LTH:
-			printf("  cmp rax, rdi\n");
-			printf("  setl al\n");
-			printf("  movzb rax, al\n");
+			Emit(pCtx, "  cmp rax, rdi\n");
+			Emit(pCtx, "  setl al\n");
+			Emit(pCtx, "  movzb rax, al\n");
 			break;
 		case ND_LEQ:
-			printf("  cmp rax, rdi\n");
-			printf("  setle al\n");
-			printf("  movzb rax, al\n");
+			Emit(pCtx, "  cmp rax, rdi\n");
+			Emit(pCtx, "  setle al\n");
+			Emit(pCtx, "  movzb rax, al\n");
 			break;
 		default:
-			fprintf(stderr, "This kind is not recognized.");
-			exit(1);
+			Error(pCtx, "This kind is not recognized.");
 	}
 
-	printf("  push rax\n");
+	EmitPush(pCtx, "rax");
 }
+// 子の評価後: 片方の値をraxに，もう片方をオペランド(pOperand)に揃える
+// 戻り値は両辺を入れ替えたか(raxが右辺)
+static bool GenOperands(struct MccContext* const pCtx, const struct Node* const pNode, const enum BinaryTile tile, char* const pBuf, const size_t size, const char** const ppOperand)
+{
+	switch(tile)
+	{
+		case BT_RHS_LEAF:
+			*ppOperand = GetLeafOperand(pCtx, pNode->pRhs, pBuf, size);
+			return false;
+		case BT_LHS_LEAF:
+			*ppOperand = GetLeafOperand(pCtx, pNode->pLhs, pBuf, size);
+			return true;
+		default:
+			// 先に求めた側が積んである．どちらでも左辺をrax，右辺をrdiにする
+			if (pNode->isRhsFirst)
+			{
+				EmitPop(pCtx, "rdi");
+			}
+			else
+			{
+				Emit(pCtx, "  mov rdi, rax\n");
+				EmitPop(pCtx, "rax");
+			}
+			*ppOperand = "rdi";
+			return false;
+	}
+}
+// 二項演算の子の評価(BT_STACK以外): 先に求める側から作業スタックに積む
+static void PushOperandWorks(struct GenWorkStack* const pStack, const struct Node* const pNode, const enum BinaryTile tile)
+{
+	switch(tile)
+	{
+		case BT_RHS_LEAF:
+			PushWork(pStack, pNode->pLhs, GP_EVAL, GD_RAX);
+			return;
+		case BT_LHS_LEAF:
+			PushWork(pStack, pNode->pRhs, GP_EVAL, GD_RAX);
+			return;
+		default:
+			if (pNode->isRhsFirst)
+			{
+				PushWork(pStack, pNode->pLhs, GP_EVAL, GD_RAX);
+				PushWork(pStack, pNode->pRhs, GP_EVAL, GD_STACK);
+			}
+			else
+			{
+				PushWork(pStack, pNode->pRhs, GP_EVAL, GD_RAX);
+				PushWork(pStack, pNode->pLhs, GP_EVAL, GD_STACK);
+			}
+			return;
+	}
+}
+// 敷き詰めた二項演算: 結果はraxに残る
+static void GenOperation(struct MccContext* const pCtx, const struct Node* const pNode, const enum BinaryTile tile)
+{
+	const struct Node* const pLeaf = (tile == BT_RHS_LEAF) ? pNode->pRhs : (tile == BT_LHS_LEAF) ? pNode->pLhs : NULL;
+	const bool isImmediate = (pLeaf != NULL && pLeaf->kind == ND_NUM);
+	const bool isOne = (isImmediate && pLeaf->value == 1);
+
+	// idivは即値を取らず，割られる数がraxに要る
+	if (pNode->kind == ND_DIV)
+	{
+		char buf[64];
+		const char* pDivisor = "rdi";
+		if (tile == BT_LHS_LEAF)
+		{
+			Emit(pCtx, "  mov rdi, rax\n");
+			GenLoadLeaf(pCtx, pNode->pLhs, "rax");
+		}
+		else if (isImmediate)
+		{
+			GenLoadLeaf(pCtx, pLeaf, "rdi");
+		}
+		else
+		{
+			GenOperands(pCtx, pNode, tile, buf, sizeof(buf), &pDivisor);
+		}
+		Emit(pCtx, "  cqo\n");
+		Emit(pCtx, "  idiv %s\n", pDivisor);
+		return;
+	}
 
+	char buf[64];
+	const char* pOperand = NULL;
+	const bool isSwapped = GenOperands(pCtx, pNode, tile, buf, sizeof(buf), &pOperand);
+	switch(pNode->kind)
+	{
+		case ND_ADD:
+			if (isOne) { Emit(pCtx, "  inc rax\n"); }
+			else       { Emit(pCtx, "  add rax, %s\n", pOperand); }
+			return;
+		case ND_SUB:
+			// E - x = -x + E
+			if (isSwapped)
+			{
+				Emit(pCtx, "  neg rax\n");
+				Emit(pCtx, "  add rax, %s\n", pOperand);
+			}
+			else if (isOne) { Emit(pCtx, "  dec rax\n"); }
+			else            { Emit(pCtx, "  sub rax, %s\n", pOperand); }
+			return;
+		case ND_MUL:
+			if (isImmediate) { Emit(pCtx, "  imul rax, rax, %s\n", pOperand); }
+			else             { Emit(pCtx, "  imul rax, %s\n", pOperand); }
+			return;
+		case ND_EQU:
+		case ND_NEQ:
+		case ND_LTH:
+		case ND_LEQ:
+			Emit(pCtx, "  cmp rax, %s\n", pOperand);
+			Emit(pCtx, "  set%s al\n", GetCondCode(pNode->kind, isSwapped, false));
+			Emit(pCtx, "  movzb rax, al\n");
+			return;
+		default:
+			Error(pCtx, "This kind is not recognized.");
+	}
+}
+// 変数への代入: 値(dest != GD_NONE)はraxに残る
+static void GenAssign(struct MccContext* const pCtx, const struct Node* const pNode, const enum AssignTile tile, const enum GenDest dest)
+{
+	const struct LocalVar* const pLVar = pNode->pLhs->pLVar;
+	const bool isInt = (pLVar->size == 4);
+	char mem[64];
+	switch(tile)
+	{
+		case AT_IMMEDIATE:
+			FormatLocal(pCtx, pLVar, mem, sizeof(mem));
+			Emit(pCtx, "  mov %s, %d\n", mem, pNode->pRhs->value);
+			if (dest != GD_NONE) { GenLoadLeaf(pCtx, pNode->pRhs, "rax"); }
+			return;
+		case AT_UPDATE:
+		{
+			// 値はraxにある(定数なら即値)．intは32bitのまま足せば切り詰めたことになる
+			const struct Node* const pOperand = GetUpdateOperand(pNode);
+			const bool isAdd = (pNode->pRhs->kind == ND_ADD);
+			FormatLocal(pCtx, pLVar, mem, sizeof(mem));
+			if (pOperand->kind == ND_NUM && pOperand->value == 1) { Emit(pCtx, "  %s %s\n", isAdd ? "inc" : "dec", mem); }
+			else if (pOperand->kind == ND_NUM)                    { Emit(pCtx, "  %s %s, %d\n", isAdd ? "add" : "sub", mem, pOperand->value); }
+			else                                                  { Emit(pCtx, "  %s %s, %s\n", isAdd ? "add" : "sub", mem, isInt ? "eax" : "rax"); }
+			if (dest != GD_NONE) { GenLoadLeaf(pCtx, pNode->pLhs, "rax"); }
+			return;
+		}
+		default:
+			// intへの代入は式の値も32bitに切り詰める
+			FormatLocal(pCtx, pLVar, mem, sizeof(mem));
+			Emit(pCtx, "  mov %s, %s\n", mem, isInt ? "eax" : "rax");
+			if (isInt && dest != GD_NONE) { Emit(pCtx, "  movsxd rax, eax\n"); }
+			return;
+	}
+}
+// A ? B : C の部品を評価順に並べる(比較なら両辺，B，C)．regsは選ぶときに置くレジスタ
+static int GetSelectParts(const struct Node* const pNode, const struct Node* pParts[], const char* regs[])
+{
+	int count = 0;
+	if (IsFusedCompare(pNode->pCond))
+	{
+		pParts[count] = pNode->pCond->pLhs; regs[count++] = "rcx";
+		pParts[count] = pNode->pCond->pRhs; regs[count++] = "rsi";
+	}
+	else
+	{
+		pParts[count] = pNode->pCond; regs[count++] = "rcx";
+	}
+	pParts[count] = pNode->pLhs; regs[count++] = "rax";
+	pParts[count] = pNode->pRhs; regs[count++] = "rdi";
+	return count;
+}
+// 部品のうち最後に評価する葉でないもの(raxで受け取る)
+static int GetLastSelectPart(const struct Node* const pParts[], const int count)
+{
+	int last = -1;
+	for (int i = 0; i < count; ++i)
+	{
+		if (!IsLeafNode(pParts[i])) { last = i; }
+	}
+	return last;
+}
+static void PushSelectWorks(struct GenWorkStack* const pStack, const struct Node* const pNode)
+{
+	const struct Node* pParts[4];
+	const char* regs[4];
+	const int count = GetSelectParts(pNode, pParts, regs);
+	const int last = GetLastSelectPart(pParts, count);
+	for (int i = count - 1; i >= 0; --i)
+	{
+		if (!IsLeafNode(pParts[i])) { PushWork(pStack, pParts[i], GP_EVAL, (i == last) ? GD_RAX : GD_STACK); }
+	}
+}
+// A ? B : C: 評価した値から分岐せずに選ぶ(結果はraxに残る)
+// ifの変換で作られ副作用がないので，葉は評価順に関係なく最後に読む
+static void GenSelect(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	const bool isFused = IsFusedCompare(pNode->pCond);
+	if (!pCtx->option.isIsel)
+	{
+		EmitPop(pCtx, "rdi"); // C
+		EmitPop(pCtx, "rax"); // B
+		if (isFused)
+		{
+			EmitPop(pCtx, "rsi");
+			EmitPop(pCtx, "rcx");
+			Emit(pCtx, "  cmp rcx, rsi\n");
+		}
+		else
+		{
+			EmitPop(pCtx, "rcx");
+			Emit(pCtx, "  cmp rcx, 0\n");
+		}
+		Emit(pCtx, "  cmov%s rax, rdi\n", GetCondCode(pNode->pCond->kind, false, true));
+		return;
+	}
+
+	const struct Node* pParts[4];
+	const char* regs[4];
+	const int count = GetSelectParts(pNode, pParts, regs);
+	const int last = GetLastSelectPart(pParts, count);
+	if (last >= 0 && strcmp(regs[last], "rax") != 0) { Emit(pCtx, "  mov %s, rax\n", regs[last]); }
+	for (int i = count - 1; i >= 0; --i)
+	{
+		if (!IsLeafNode(pParts[i]) && i != last) { EmitPop(pCtx, regs[i]); }
+	}
+
+	// 比較の右辺の葉は即値/メモリのままcmpに渡す
+	const struct Node* const pRhs = isFused ? pParts[1] : NULL;
+	const bool isRhsOperand = (pRhs != NULL && IsLeafNode(pRhs) && (pRhs->kind == ND_NUM || pRhs->pLVar->size == 8));
+	for (int i = 0; i < count; ++i)
+	{
+		if (IsLeafNode(pParts[i]) && !(isRhsOperand && i == 1)) { GenLoadLeaf(pCtx, pParts[i], regs[i]); }
+	}
+	char buf[64] = "rsi";
+	if (isRhsOperand && pRhs->kind == ND_NUM) { snprintf(buf, sizeof(buf), "%d", pRhs->value); }
+	else if (isRhsOperand)                    { FormatLocal(pCtx, pRhs->pLVar, buf, sizeof(buf)); }
+	Emit(pCtx, "  cmp rcx, %s\n", isFused ? buf : "0");
+	Emit(pCtx, "  cmov%s rax, rdi\n", GetCondCode(pNode->pCond->kind, false, true));
+}
+// 葉を置き場所へ
+static void GenLeaf(struct MccContext* const pCtx, const struct Node* const pNode, const enum GenDest dest)
+{
+	if (dest == GD_NONE) { return; }
+	if (dest == GD_RAX)
+	{
+		GenLoadLeaf(pCtx, pNode, "rax");
+		return;
+	}
+	if (pNode->kind == ND_NUM)
+	{
+		Emit(pCtx, "  push %d\n", pNode->value);
+		CountPush(pCtx);
+	}
+	else if (pCtx->option.isIsel && pNode->pLVar->size == 8)
+	{
+		// pushのアドレスは積む前のrspで計算される
+		char mem[64];
+		FormatLocal(pCtx, pNode->pLVar, mem, sizeof(mem));
+		Emit(pCtx, "  push %s\n", mem);
+		CountPush(pCtx);
+	}
+	else if (pCtx->option.isIsel)
+	{
+		GenLoadLeaf(pCtx, pNode, "rax");
+		EmitPush(pCtx, "rax");
+	}
+	else
+	{
+		GenLval(pCtx, pNode);
+		EmitPop(pCtx, "rax");
+		if (pNode->pLVar->size == 4) { Emit(pCtx, "  movsxd rax, dword ptr [rax]\n"); }
+		else                         { Emit(pCtx, "  mov rax, [rax]\n"); }
+		EmitPush(pCtx, "rax");
+	}
+}
+void GenExpr(struct MccContext* const pCtx, const struct Node* const pNode, const int dest)
+{
+	assert(pNode != NULL);
+
+	struct GenWorkStack stack;
+	stack.pCtx = pCtx;
+	stack.pData = NULL;
+	stack.size = 0;
+	// -fno-iselでは全て積み，最後にraxへ下ろす
+	const bool isIsel = pCtx->option.isIsel;
+	PushWork(&stack, pNode, GP_EVAL, isIsel ? dest : GD_STACK);
+
+	while(stack.size > 0)
+	{
+		const struct GenWork work = stack.pData[--stack.size];
+		const struct Node* const pCur = work.pNode;
+		const enum GenDest curDest = (enum GenDest)work.dest;
+
+		if (work.phase == GP_ADDRESS)
+		{
+			GenLval(pCtx, pCur);
+			continue;
+		}
+		if (work.phase == GP_APPLY)
+		{
+			if (pCur->kind == ND_SELECT)
+			{
+				GenSelect(pCtx, pCur);
+				GenResult(pCtx, curDest);
+			}
+			else if (pCur->kind == ND_ASSIGN && isIsel)
+			{
+				GenAssign(pCtx, pCur, GetAssignTile(pCtx, pCur), curDest);
+				GenResult(pCtx, curDest);
+			}
+			else if (isIsel)
+			{
+				GenOperation(pCtx, pCur, GetBinaryTile(pCtx, pCur));
+				GenResult(pCtx, curDest);
+			}
+			else
+			{
+				GenBinary(pCtx, pCur);
+			}
+			continue;
+		}
+
+		switch(pCur->kind)
+		{
+			case ND_NUM:
+			case ND_LVAR:
+				GenLeaf(pCtx, pCur, curDest);
+				continue;
+			case ND_FUNC:
+				GenCall(pCtx, pCur);
+				GenResult(pCtx, curDest);
+				continue;
+			case ND_SELECT:
+				PushWork(&stack, pCur, GP_APPLY, curDest);
+				if (isIsel)
+				{
+					PushSelectWorks(&stack, pCur);
+					continue;
+				}
+				PushWork(&stack, pCur->pRhs, GP_EVAL, GD_STACK);
+				PushWork(&stack, pCur->pLhs, GP_EVAL, GD_STACK);
+				if (IsFusedCompare(pCur->pCond))
+				{
+					PushWork(&stack, pCur->pCond->pRhs, GP_EVAL, GD_STACK);
+					PushWork(&stack, pCur->pCond->pLhs, GP_EVAL, GD_STACK);
+				}
+				else
+				{
+					PushWork(&stack, pCur->pCond, GP_EVAL, GD_STACK);
+				}
+				continue;
+			default:
+				break;
+		}
+
+		if (pCur->kind == ND_ASSIGN && isIsel)
+		{
+			// GenLvalを通らないので左辺はここで確かめる
+			if (pCur->pLhs->kind != ND_LVAR)
+			{
+				Error(pCtx, "Left is not varialble.");
+			}
+			const enum AssignTile tile = GetAssignTile(pCtx, pCur);
+			const struct Node* const pOperand = (tile == AT_UPDATE) ? GetUpdateOperand(pCur) : NULL;
+			// 定数だけで済むものはここで出す
+			if (tile == AT_IMMEDIATE || (pOperand != NULL && pOperand->kind == ND_NUM))
+			{
+				GenAssign(pCtx, pCur, tile, curDest);
+				GenResult(pCtx, curDest);
+				continue;
+			}
+			PushWork(&stack, pCur, GP_APPLY, curDest);
+			PushWork(&stack, (pOperand != NULL) ? pOperand : pCur->pRhs, GP_EVAL, GD_RAX);
+			continue;
+		}
+		if (isIsel)
+		{
+			PushWork(&stack, pCur, GP_APPLY, curDest);
+			PushOperandWorks(&stack, pCur, GetBinaryTile(pCtx, pCur));
+			continue;
+		}
+
+		// Sethi-Ullman数の大きい方を先に評価する(作業スタックは後入れ先出し)
+		const enum GenPhase lhsPhase = (pCur->kind == ND_ASSIGN) ? GP_ADDRESS : GP_EVAL;
+		PushWork(&stack, pCur, GP_APPLY, GD_STACK);
+		if (pCur->isRhsFirst)
+		{
+			PushWork(&stack, pCur->pLhs, lhsPhase, GD_STACK);
+			PushWork(&stack, pCur->pRhs, GP_EVAL, GD_STACK);
+		}
+		else
+		{
+			PushWork(&stack, pCur->pRhs, GP_EVAL, GD_STACK);
+			PushWork(&stack, pCur->pLhs, lhsPhase, GD_STACK);
+		}
+	}
+
+	if (!isIsel && dest != GD_STACK) { EmitPop(pCtx, "rax"); }
+}
+// 条件を評価して，真(isJumpIfTrue)/偽ならラベルへ飛ぶ
+// 文の値を使わなければ比較の結果を0/1にせず，フラグで直接分岐する(cmp [x], imm / cmp rax, E)
+static void GenCondJump(struct MccContext* const pCtx, const struct Node* const pCond, const bool isJumpIfTrue, const char* const pLabel, const int cnt)
+{
+	if (!pCtx->option.isIsel || pCtx->isStmtValueUsed)
+	{
+		// 条件の値がraxに残る
+		GenExpr(pCtx, pCond, GD_RAX);
+		Emit(pCtx, "  cmp rax, 0\n");
+		Emit(pCtx, "  %s .L%s%d\n", isJumpIfTrue ? "jne" : "je", pLabel, cnt);
+		return;
+	}
+
+	char buf[64];
+	bool isSwapped = false;
+	if (pCond->kind == ND_LVAR)
+	{
+		FormatLocal(pCtx, pCond->pLVar, buf, sizeof(buf));
+		Emit(pCtx, "  cmp %s, 0\n", buf);
+	}
+	else if (!IsFusedCompare(pCond))
+	{
+		GenExpr(pCtx, pCond, GD_RAX);
+		Emit(pCtx, "  cmp rax, 0\n");
+	}
+	else if (pCond->pLhs->kind == ND_LVAR && pCond->pRhs->kind == ND_NUM)
+	{
+		FormatLocal(pCtx, pCond->pLhs->pLVar, buf, sizeof(buf));
+		Emit(pCtx, "  cmp %s, %d\n", buf, pCond->pRhs->value);
+	}
+	else if (pCond->pLhs->kind == ND_NUM && pCond->pRhs->kind == ND_LVAR)
+	{
+		FormatLocal(pCtx, pCond->pRhs->pLVar, buf, sizeof(buf));
+		Emit(pCtx, "  cmp %s, %d\n", buf, pCond->pLhs->value);
+		isSwapped = true;
+	}
+	else
+	{
+		const enum BinaryTile tile = GetBinaryTile(pCtx, pCond);
+		if (tile == BT_RHS_LEAF)      { GenExpr(pCtx, pCond->pLhs, GD_RAX); }
+		else if (tile == BT_LHS_LEAF) { GenExpr(pCtx, pCond->pRhs, GD_RAX); }
+		else
+		{
+			const struct Node* const pFirst = pCond->isRhsFirst ? pCond->pRhs : pCond->pLhs;
+			const struct Node* const pSecond = pCond->isRhsFirst ? pCond->pLhs : pCond->pRhs;
+			GenExpr(pCtx, pFirst, GD_STACK);
+			GenExpr(pCtx, pSecond, GD_RAX);
+		}
+		const char* pOperand = NULL;
+		isSwapped = GenOperands(pCtx, pCond, tile, buf, sizeof(buf), &pOperand);
+		Emit(pCtx, "  cmp rax, %s\n", pOperand);
+	}
+	Emit(pCtx, "  j%s .L%s%d\n", GetCondCode(pCond->kind, isSwapped, !isJumpIfTrue), pLabel, cnt);
+}
+
+// -- PROFILE --
+static void GenProfileCount(struct MccContext* const pCtx, const struct Node* const pNode, const enum ProfileArm arm)
+{
+	if (!pCtx->option.isProfileGenerate || pNode->srcPos < 0) { return; }
+	const int index = GetProfileCounterIndex(pCtx, pNode->srcPos) + arm;
+	Emit(pCtx, "  inc qword ptr [rip + .Lprofcnt + %d]\n", index * 8);
+}
+// ifの腕を生成する(thenならカウンタを数える)
+static void GenIfArm(struct MccContext* const pCtx, const struct Node* const pNode, const bool isThen)
+{
+	if (isThen)
+	{
+		GenProfileCount(pCtx, pNode, PROF_TAKEN);
+		Gen(pCtx, pNode->pThen);
+	}
+	else if (pNode->pElse != NULL)
+	{
+		Gen(pCtx, pNode->pElse);
+	}
+}
+static void AddColdBlock(struct MccContext* const pCtx, const struct Node* const pNode, const bool isThen, const int labelIndex)
+{
+	struct ColdBlock* const pColdBlocks = (struct ColdBlock*)ReserveBuffer(&pCtx->coldBlocks, pCtx->coldBlockSize + 1, sizeof(struct ColdBlock));
+	struct ColdBlock* const pBlock = &pColdBlocks[pCtx->coldBlockSize++];
+	pBlock->pNode = pNode;
+	pBlock->isThen = isThen;
+	pBlock->labelIndex = labelIndex;
+	pBlock->breakIndex = pCtx->breakIndex;
+}
+// 追い出した腕をmainのエピローグの後ろに生成する
+void GenColdBlocks(struct MccContext* const pCtx)
+{
+	// 生成中に増えることがあるので毎回sizeを見る
+	for (int i = 0; i < pCtx->coldBlockSize; ++i)
+	{
+		const struct ColdBlock block = ((const struct ColdBlock*)pCtx->coldBlocks.pData)[i];
+		const int outerBreakIndex = pCtx->breakIndex;
+		pCtx->breakIndex = block.breakIndex;
+		Emit(pCtx, ".Lcold%d:\n", block.labelIndex);
+		GenIfArm(pCtx, block.pNode, block.isThen);
+		Emit(pCtx, "  jmp .Lend%d\n", block.labelIndex);
+		pCtx->breakIndex = outerBreakIndex;
+	}
+	pCtx->coldBlockSize = 0;
+}
+// if(A) B else C: プロファイルがあれば多く通る腕を分岐なしで通す
+static void GenIf(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	int cnt = pCtx->jumpIndex++;
+	GenProfileCount(pCtx, pNode, PROF_ENTRY);
+
+	bool isThenFirst = true;
+	bool isOutOfLine = false;
+	if (pCtx->option.isProfileUse && pNode->hasProfile)
+	{
+		const long long thenCount = pNode->profTaken;
+		const long long elseCount = pNode->profEntry - pNode->profTaken;
+		isThenFirst = (thenCount >= elseCount);
+		const long long hotCount = isThenFirst ? thenCount : elseCount;
+		const long long coldCount = isThenFirst ? elseCount : thenCount;
+		isOutOfLine = (hotCount > 0 && coldCount * PROFILE_COLD_RATIO <= hotCount);
+	}
+	// 空のelseより先にthenを置く意味はないので，追い出せないなら元の並び
+	if (!isThenFirst && pNode->pElse == NULL && !isOutOfLine) { isThenFirst = true; }
+	// 後ろに置く腕がなければ追い出すものもない
+	if (isThenFirst && pNode->pElse == NULL) { isOutOfLine = false; }
+
+	// 後ろの腕へ飛ぶ条件: thenへはAが真, elseへはAが偽
+	const bool isJumpIfTrue = !isThenFirst;
+	if (isOutOfLine)
+	{
+		GenCondJump(pCtx, pNode->pCond, isJumpIfTrue, "cold", cnt); // A
+		GenIfArm(pCtx, pNode, isThenFirst);
+		AddColdBlock(pCtx, pNode, !isThenFirst, cnt);
+	}
+	else if (isThenFirst && pNode->pElse == NULL) // if文単体
+	{
+		GenCondJump(pCtx, pNode->pCond, false, "end", cnt); // A
+		GenIfArm(pCtx, pNode, true); // B
+	}
+	else // if-else
+	{
+		GenCondJump(pCtx, pNode->pCond, isJumpIfTrue, "else", cnt); // A
+		GenIfArm(pCtx, pNode, isThenFirst);
+		Emit(pCtx, "  jmp .Lend%d\n", cnt);
+		Emit(pCtx, ".Lelse%d:\n", cnt);
+		GenIfArm(pCtx, pNode, !isThenFirst);
+	}
+	Emit(pCtx, ".Lend%d:\n", cnt);
+}
+
+// -- LOOP --
+// ループ先頭を揃える．プロファイルで回らないと分かっているループは揃えない
+static void GenLoopAlign(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	if (pCtx->option.loopAlign <= 1) { return; }
+	if (pCtx->option.isProfileUse && pNode->hasProfile && (pNode->profTaken < pNode->profEntry * PROFILE_HOT_TRIP || pNode->profTaken == 0)) { return; }
+	int power = 0;
+	while((1 << power) < pCtx->option.loopAlign) { ++power; }
+	Emit(pCtx, "  .p2align %d\n", power);
+}
+// while(A) B
+// 回転しない: .Lbegin: A; je .Lend; B; jmp .Lbegin
+// 回転する:   A; je .Lend; .Lbegin: B; A; jne .Lbegin (1周ごとの無条件分岐がなくなる)
+static void GenWhile(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	const int cnt = pCtx->jumpIndex++;
+	const int outerBreakIndex = pCtx->breakIndex;
+	pCtx->breakIndex = cnt;
+	GenProfileCount(pCtx, pNode, PROF_ENTRY);
+	if (pCtx->option.isRotateLoops)
+	{
+		GenCondJump(pCtx, pNode->pCond, false, "end", cnt);
+		GenLoopAlign(pCtx, pNode);
+		Emit(pCtx, ".Lbegin%d:\n", cnt);
+		Gen(pCtx, pNode->pThen);
+		GenProfileCount(pCtx, pNode, PROF_TAKEN);
+		GenCondJump(pCtx, pNode->pCond, true, "begin", cnt);
+	}
+	else
+	{
+		GenLoopAlign(pCtx, pNode);
+		Emit(pCtx, ".Lbegin%d:\n", cnt);
+		GenCondJump(pCtx, pNode->pCond, false, "end", cnt);
+		Gen(pCtx, pNode->pThen);
+		GenProfileCount(pCtx, pNode, PROF_TAKEN);
+		Emit(pCtx, "  jmp .Lbegin%d\n", cnt);
+	}
+	Emit(pCtx, ".Lend%d:\n", cnt);
+	pCtx->breakIndex = outerBreakIndex;
+}
+
+// -- SWITCH --
+static int CompareCaseValue(const void* pA, const void* pB)
+{
+	const struct Node* const pCaseA = *(const struct Node* const*)pA;
+	const struct Node* const pCaseB = *(const struct Node* const*)pB;
+	if (pCaseA->value < pCaseB->value) { return -1; }
+	if (pCaseA->value > pCaseB->value) { return 1; }
+	return 0;
+}
+// caseを1つずつ比較する(raxにswitchの値)
+static void GenSwitchLinear(struct MccContext* const pCtx, struct Node* const pCases[], const int first, const int last, const char* const pDefaultLabel)
+{
+	for (int i = first; i <= last; ++i)
+	{
+		Emit(pCtx, "  cmp rax, %d\n", pCases[i]->value);
+		Emit(pCtx, "  je .Lcase%d\n", pCases[i]->labelIndex);
+	}
+	Emit(pCtx, "  jmp %s\n", pDefaultLabel);
+}
+// ソート済みのcaseを二分探索する
+static void GenSwitchBinary(struct MccContext* const pCtx, struct Node* const pCases[], const int first, const int last, const char* const pDefaultLabel)
+{
+	if (last - first + 1 <= SWITCH_LINEAR_MAX)
+	{
+		GenSwitchLinear(pCtx, pCases, first, last, pDefaultLabel);
+		return;
+	}
+	const int mid = first + (last - first) / 2;
+	const int cnt = pCtx->jumpIndex++;
+	Emit(pCtx, "  cmp rax, %d\n", pCases[mid]->value);
+	Emit(pCtx, "  je .Lcase%d\n", pCases[mid]->labelIndex);
+	Emit(pCtx, "  jl .Lsearch%d\n", cnt);
+	GenSwitchBinary(pCtx, pCases, mid + 1, last, pDefaultLabel);
+	Emit(pCtx, ".Lsearch%d:\n", cnt);
+	GenSwitchBinary(pCtx, pCases, first, mid - 1, pDefaultLabel);
+}
+// 値の範囲をそのまま添字にした表で飛ぶ(範囲外はdefaultへ)
+static void GenSwitchTable(struct MccContext* const pCtx, struct Node* const pCases[], const int count, const char* const pDefaultLabel)
+{
+	const int cnt = pCtx->jumpIndex++;
+	const int minValue = pCases[0]->value;
+	const long long range = (long long)pCases[count - 1]->value - minValue + 1;
+
+	if (minValue != 0) { Emit(pCtx, "  sub rax, %d\n", minValue); }
+	Emit(pCtx, "  cmp rax, %lld\n", range - 1);
+	Emit(pCtx, "  ja %s\n", pDefaultLabel);
+	Emit(pCtx, "  lea rdi, [rip + .Ltable%d]\n", cnt);
+	Emit(pCtx, "  movsxd rax, dword ptr [rdi + rax * 4]\n");
+	Emit(pCtx, "  add rax, rdi\n");
+	Emit(pCtx, "  jmp rax\n");
+
+	// 表は位置独立にするためラベル間の差で持つ
+	Emit(pCtx, "  .section .rodata\n");
+	Emit(pCtx, "  .p2align 2\n");
+	Emit(pCtx, ".Ltable%d:\n", cnt);
+	int index = 0;
+	for (long long value = minValue; value < minValue + range; ++value)
+	{
+		if (pCases[index]->value == value)
+		{
+			Emit(pCtx, "  .long .Lcase%d - .Ltable%d\n", pCases[index]->labelIndex, cnt);
+			++index;
+		}
+		else
+		{
+			Emit(pCtx, "  .long %s - .Ltable%d\n", pDefaultLabel, cnt);
+		}
+	}
+	Emit(pCtx, "  .text\n");
+}
+// switchの値(rax)からcaseへ分岐する．case数と値の密度で方法を選ぶ
+static void GenSwitchDispatch(struct MccContext* const pCtx, const struct Node* const pNode, const int cnt)
+{
+	char defaultLabel[32] = {};
+	if (pNode->pDefault != NULL)
+	{
+		pNode->pDefault->labelIndex = pCtx->jumpIndex++;
+		snprintf(defaultLabel, sizeof(defaultLabel), ".Lcase%d", pNode->pDefault->labelIndex);
+	}
+	else
+	{
+		snprintf(defaultLabel, sizeof(defaultLabel), ".Lend%d", cnt);
+	}
+
+	int count = 0;
+	for (const struct Node* pCase = pNode->pCaseNext; pCase != NULL; pCase = pCase->pCaseNext) { ++count; }
+	if (count == 0)
+	{
+		Emit(pCtx, "  jmp %s\n", defaultLabel);
+		return;
+	}
+
+	struct Node** const pCases = (struct Node**)ArenaAlloc(pCtx, count * sizeof(struct Node*));
+	int i = 0;
+	for (struct Node* pCase = pNode->pCaseNext; pCase != NULL; pCase = pCase->pCaseNext)
+	{
+		pCase->labelIndex = pCtx->jumpIndex++;
+		pCases[i++] = pCase;
+	}
+	qsort(pCases, count, sizeof(struct Node*), CompareCaseValue);
+	// 値の重複は構文解析で弾いている
+	for (i = 1; i < count; ++i) { assert(pCases[i - 1]->value != pCases[i]->value); }
+
+	const long long range = (long long)pCases[count - 1]->value - pCases[0]->value + 1;
+	if (count <= SWITCH_LINEAR_MAX)
+	{
+		GenSwitchLinear(pCtx, pCases, 0, count - 1, defaultLabel);
+	}
+	else if (range <= (long long)count * SWITCH_TABLE_DENSITY && range <= SWITCH_TABLE_MAX)
+	{
+		GenSwitchTable(pCtx, pCases, count, defaultLabel);
+	}
+	else
+	{
+		GenSwitchBinary(pCtx, pCases, 0, count - 1, defaultLabel);
+	}
+}
+
+// 文の生成: 文の前後でスタック段数は変わらない
+void Gen(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	assert(pNode != NULL);
+
+	switch(pNode->kind)
+	{
+		case ND_RTN:
+			GenExpr(pCtx, pNode->pLhs, GD_RAX);
+			GenEpilogue(pCtx);
+			return;
+		case ND_IF: // if(A) B else C
+			GenIf(pCtx, pNode);
+			return;
+		case ND_WHILE:
+			GenWhile(pCtx, pNode);
+			return;
+		case ND_BLOCK:
+			for (const struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext)
+			{
+				Gen(pCtx, pTmp);
+			}
+			return;
+		case ND_SWITCH:
+		{
+			int cnt = pCtx->jumpIndex++;
+			const int outerBreakIndex = pCtx->breakIndex;
+			pCtx->breakIndex = cnt;
+			GenExpr(pCtx, pNode->pCond, GD_RAX);
+			GenSwitchDispatch(pCtx, pNode, cnt);
+			Gen(pCtx, pNode->pThen);
+			Emit(pCtx, ".Lend%d:\n", cnt);
+			pCtx->breakIndex = outerBreakIndex;
+			return;
+		}
+		case ND_CASE:
+		case ND_DEFAULT:
+			Emit(pCtx, ".Lcase%d:\n", pNode->labelIndex);
+			Gen(pCtx, pNode->pThen);
+			return;
+		case ND_BREAK:
+			assert(pCtx->breakIndex >= 0);
+			Emit(pCtx, "  jmp .Lend%d\n", pCtx->breakIndex);
+			return;
+		default:
+			break;
+	}
+
+	// 式文: 値はraxに残す(最後の式の値がmainの戻り値になる)
+	GenExpr(pCtx, pNode, pCtx->isStmtValueUsed ? GD_RAX : GD_NONE);
+}
@@ -0,0 +1,293 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+#define DEFAULT_PROFILE_PATH "mcc.prof"
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+// -- MEMORY --
+void* ArenaAlloc(struct MccContext* const pCtx, const size_t size)
+{
+	struct Arena* const pArena = &pCtx->arena;
+	const size_t alignedSize = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	const size_t headerSize = (sizeof(struct ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	// 前回のコンパイルで確保したブロックから順に使い回す
+	while(pArena->pCurrent != NULL && pArena->pCurrent->used + alignedSize > pArena->pCurrent->size)
+	{
+		if (pArena->pCurrent->next == NULL) { break; }
+		pArena->pCurrent = pArena->pCurrent->next;
+	}
+	if (pArena->pCurrent == NULL || pArena->pCurrent->used + alignedSize > pArena->pCurrent->size)
+	{
+		const size_t blockSize = (alignedSize > ARENA_BLOCK_SIZE) ? alignedSize : ARENA_BLOCK_SIZE;
+		struct ArenaBlock* const pBlock = (struct ArenaBlock*)malloc(headerSize + blockSize);
+		if (pBlock == NULL) { Error(pCtx, "Out of memory."); }
+		pBlock->next = NULL;
+		pBlock->size = blockSize;
+		pBlock->used = 0;
+		if (pArena->pCurrent == NULL) { pArena->pHead = pBlock; }
+		else { pArena->pCurrent->next = pBlock; }
+		pArena->pCurrent = pBlock;
+	}
+
+	void* const pData = (char*)pArena->pCurrent + headerSize + pArena->pCurrent->used;
+	pArena->pCurrent->used += alignedSize;
+	pArena->allocSize += alignedSize;
+	return pData;
+}
+// ブロックは解放せずに空にする
+void ResetArena(struct Arena* const pArena)
+{
+	for (struct ArenaBlock* pBlock = pArena->pHead; pBlock != NULL; pBlock = pBlock->next) { pBlock->used = 0; }
+	pArena->pCurrent = pArena->pHead;
+	pArena->allocSize = 0;
+}
+void ReleaseArena(struct Arena* const pArena)
+{
+	struct ArenaBlock* pBlock = pArena->pHead;
+	while(pBlock != NULL)
+	{
+		struct ArenaBlock* const pNext = pBlock->next;
+		free(pBlock);
+		pBlock = pNext;
+	}
+	pArena->pHead = NULL;
+	pArena->pCurrent = NULL;
+	pArena->allocSize = 0;
+}
+// 少なくともcount要素入るようにする(中身は保つ)
+void* ReserveBuffer(struct Buffer* const pBuffer, const int count, const size_t elementSize)
+{
+	if (count > pBuffer->capacity)
+	{
+		int capacity = (pBuffer->capacity == 0) ? 16 : pBuffer->capacity;
+		while(capacity < count) { capacity *= 2; }
+		void* const pData = realloc(pBuffer->pData, capacity * elementSize);
+		assert(pData != NULL);
+		pBuffer->pData = pData;
+		pBuffer->capacity = capacity;
+	}
+	return pBuffer->pData;
+}
+void ReleaseBuffer(struct Buffer* const pBuffer)
+{
+	free(pBuffer->pData);
+	pBuffer->pData = NULL;
+	pBuffer->capacity = 0;
+}
+
+// -- OUTPUT --
+void mcc_init_out_buffer(struct OutBuffer* const pOut)
+{
+	pOut->pData = NULL;
+	pOut->size = 0;
+	pOut->capacity = 0;
+}
+void mcc_release_out_buffer(struct OutBuffer* const pOut)
+{
+	free(pOut->pData);
+	mcc_init_out_buffer(pOut);
+}
+// アセンブリを出力バッファへ書く(常にNUL終端しておく)
+void Emit(struct MccContext* const pCtx, const char* const fmt, ...)
+{
+	struct OutBuffer* const pOut = pCtx->pOut;
+	while(true)
+	{
+		const size_t rest = pOut->capacity - pOut->size;
+		va_list ap;
+		va_start(ap, fmt);
+		const int len = vsnprintf((pOut->pData != NULL) ? &pOut->pData[pOut->size] : NULL, rest, fmt, ap);
+		va_end(ap);
+		assert(len >= 0);
+		if ((size_t)len < rest)
+		{
+			pOut->size += len;
+			return;
+		}
+
+		size_t capacity = (pOut->capacity == 0) ? 4096 : pOut->capacity * 2;
+		while(capacity < pOut->size + len + 1) { capacity *= 2; }
+		char* const pData = (char*)realloc(pOut->pData, capacity);
+		if (pData == NULL) { Error(pCtx, "Out of memory."); }
+		pOut->pData = pData;
+		pOut->capacity = capacity;
+	}
+}
+
+// -- ERROR --
+// 位置を持たないエラー(コード生成など)
+void Error(struct MccContext* const pCtx, const char* const fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(pCtx->errorMessage, sizeof(pCtx->errorMessage), fmt, ap);
+	va_end(ap);
+
+	longjmp(pCtx->errorJump, 1);
+}
+const char* mcc_error_message(const struct MccContext* const pCtx)
+{
+	return pCtx->errorMessage;
+}
+
+// -- CONTEXT --
+void mcc_init_option(struct Option* const pOption)
+{
+	pOption->isProfileGenerate = false;
+	pOption->isProfileUse = false;
+	pOption->pProfilePath = DEFAULT_PROFILE_PATH;
+	pOption->isStackReuse = true;
+	pOption->isCse = true;
+	pOption->scanLevel = SCAN_AVX2; // 実際にはbestScanLevelまで落とす
+	pOption->isRotateLoops = true;
+	pOption->loopAlign = 16;
+	pOption->unrollFactor = 4;
+	pOption->isOmitFramePointer = false;
+	pOption->isIfConversion = true;
+	pOption->isCcp = true;
+	pOption->isIsel = true;
+}
+struct MccContext* mcc_create_context(void)
+{
+	struct MccContext* const pCtx = (struct MccContext*)calloc(1, sizeof(struct MccContext));
+	if (pCtx == NULL) { return NULL; }
+	mcc_init_option(&pCtx->option);
+	pCtx->bestScanLevel = GetBestScanLevel();
+	pCtx->breakIndex = -1;
+	return pCtx;
+}
+void mcc_destroy_context(struct MccContext* const pCtx)
+{
+	if (pCtx == NULL) { return; }
+	ReleaseArena(&pCtx->arena);
+	ReleaseBuffer(&pCtx->exprOperands);
+	ReleaseBuffer(&pCtx->exprOperators);
+	ReleaseBuffer(&pCtx->frameVars);
+	ReleaseBuffer(&pCtx->frameSlots);
+	ReleaseBuffer(&pCtx->loopScopes);
+	ReleaseBuffer(&pCtx->loopStates);
+	ReleaseBuffer(&pCtx->valueEntries);
+	ReleaseBuffer(&pCtx->valueSlots);
+	ReleaseBuffer(&pCtx->valueUses);
+	ReleaseBuffer(&pCtx->lvarVersions);
+	ReleaseBuffer(&pCtx->propValues);
+	ReleaseBuffer(&pCtx->propReachable);
+	ReleaseBuffer(&pCtx->propOperands);
+	ReleaseBuffer(&pCtx->labelNodes);
+	ReleaseBuffer(&pCtx->labelVisited);
+	ReleaseBuffer(&pCtx->genWorks);
+	ReleaseBuffer(&pCtx->coldBlocks);
+	ReleaseBuffer(&pCtx->counterSites);
+	ReleaseBuffer(&pCtx->profileSites);
+	free(pCtx);
+}
+// コンパイルごとの状態を初期化する(アリーナと作業領域は使い回す)
+static void ResetContext(struct MccContext* const pCtx)
+{
+	ResetArena(&pCtx->arena);
+	pCtx->errorMessage[0] = '\0';
+	pCtx->pSrc = NULL;
+	pCtx->pTokens = NULL;
+	pCtx->pProgram = NULL;
+	pCtx->tokenMemoryCount = 0;
+	pCtx->nodeMemoryCount = 0;
+	pCtx->lvarMemoryCount = 0;
+
+	pCtx->firstLVar.next = NULL;
+	pCtx->firstLVar.name = NULL;
+	pCtx->firstLVar.len = 0;
+	pCtx->firstLVar.size = 0;
+	pCtx->firstLVar.offset = 0;
+	pCtx->firstLVar.index = -1;
+	pCtx->pCurrentSwitch = NULL;
+	pCtx->breakableDepth = 0;
+	pCtx->frameSize = 0;
+	memset(&pCtx->stats, 0, sizeof(pCtx->stats));
+
+	pCtx->stackDepth = 0;
+	pCtx->exprDepth = 0;
+	pCtx->hasCall = false;
+	pCtx->isStmtValueUsed = true;
+	pCtx->frameKind = FRAME_RBP;
+	pCtx->frameTop = 0;
+	pCtx->jumpIndex = 0;
+	pCtx->breakIndex = -1;
+	pCtx->coldBlockSize = 0;
+	pCtx->counterSiteSize = 0;
+	pCtx->profileSiteSize = 0;
+}
+// srcのlenバイトをコンパイルしてアセンブリをpOutの末尾に追加する
+// 失敗したときはpOutを呼び出し前の状態に戻してMCC_ERRORを返す
+enum MccResult mcc_compile(struct MccContext* const pCtx, const char* const pSrc, const size_t len, struct OutBuffer* const pOut)
+{
+	ResetContext(pCtx);
+	pCtx->pOut = pOut;
+	const size_t outSize = pOut->size;
+
+	if (setjmp(pCtx->errorJump) != 0)
+	{
+		pOut->size = outSize;
+		if (pOut->pData != NULL) { pOut->pData[outSize] = '\0'; }
+		pCtx->pOut = NULL;
+		return MCC_ERROR;
+	}
+
+	// トークナイザが後ろを読み過ぎてもよいように余白を付ける
+	pCtx->pSrc = (char*)ArenaAlloc(pCtx, len + 1 + SCAN_PADDING);
+	memcpy(pCtx->pSrc, pSrc, len);
+	memset(&pCtx->pSrc[len], '\0', 1 + SCAN_PADDING);
+
+	if (pCtx->option.isProfileUse && !LoadProfile(pCtx, pCtx->option.pProfilePath))
+	{
+		Error(pCtx, "Cannot read profile: %s", pCtx->option.pProfilePath);
+	}
+
+	// トークナイズ
+	struct Token* pToken = Tokenize(pCtx, pCtx->pSrc);
+	pCtx->pTokens = pToken;
+	pCtx->pProgram = Program(pCtx, &pToken);
+	if (pCtx->option.unrollFactor > 1) { UnrollLoops(pCtx, pCtx->pProgram); }
+	if (pCtx->option.isCcp) { PropagateConstants(pCtx, pCtx->pProgram); }
+	if (pCtx->option.isCse) { EliminateCommonSubexpressions(pCtx, pCtx->pProgram); }
+	if (pCtx->option.isProfileUse)
+	{
+		for (struct Node* pCode = pCtx->pProgram; pCode != NULL; pCode = pCode->pNext) { AttachProfile(pCtx, pCode); }
+	}
+	// 計測する版では全てのifにカウンタが要るので分岐を残す
+	if (pCtx->option.isIfConversion && !pCtx->option.isProfileGenerate) { ConvertIfs(pCtx, pCtx->pProgram); }
+	AllocateLocalVars(pCtx, pCtx->pProgram);
+
+	// アセンブリ前半
+	Emit(pCtx, ".intel_syntax noprefix\n");
+	Emit(pCtx, ".global main\n");
+	Emit(pCtx, "main:\n");
+
+	// プロローグ(式の評価に必要な段数と呼び出しの有無で変数の指し方を決める)
+	LabelNodes(pCtx, pCtx->pProgram);
+	GenPrologue(pCtx);
+	if (pCtx->option.isProfileGenerate) { GenProfileRegister(pCtx); }
+
+	// 先頭からコード生成
+	for (const struct Node* pCode = pCtx->pProgram; pCode != NULL; pCode = pCode->pNext) { Gen(pCtx, pCode); }
+
+	// エピローグ
+	GenEpilogue(pCtx);
+
+	// 実行されにくいコードとプロファイル用の実行時処理
+	GenColdBlocks(pCtx);
+	if (pCtx->option.isProfileGenerate) { GenProfileRuntime(pCtx); }
+
+	pCtx->pOut = NULL;
+	return MCC_OK;
+}
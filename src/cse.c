@@ -0,0 +1,321 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// 基本ブロックごとの値番号付けで共通部分式を見つける
+// 1. 式を評価順にたどって値番号を付け，前に同じ値が計算されていた式を記録する
+// 2. 記録した式を外側から順に，その値を持つ変数の読み出しに置き換える
+//    代入先の変数がまだその値を持っていればそれを読み，なければ最初の式を一時変数への代入にする
+// 変数への代入は版を進めるので，古い値を使う式とは一致しない
+// 関数呼び出しと制御の合流/分岐で表を空にする
+
+struct CseWalker
+{
+	struct MccContext* pCtx;
+	int entrySize;
+	int slotCapacity; // 2のべき乗
+	int slotSize;     // 今の世代で使っている数
+	int generation;
+	int useSize;
+	int* pVersions;
+};
+
+static bool IsCommutative(const enum NodeKind kind)
+{
+	return (kind == ND_ADD || kind == ND_MUL || kind == ND_EQU || kind == ND_NEQ);
+}
+static unsigned int HashValue(const int kind, const int lhs, const int rhs)
+{
+	unsigned int hash = 2166136261u;
+	hash = (hash ^ (unsigned int)kind) * 16777619u;
+	hash = (hash ^ (unsigned int)lhs) * 16777619u;
+	hash = (hash ^ (unsigned int)rhs) * 16777619u;
+	return hash;
+}
+// 基本ブロックの終わり: 表を空にする
+static void ClearValues(struct CseWalker* const pWalker)
+{
+	++pWalker->generation;
+	pWalker->slotSize = 0;
+}
+static void InsertSlot(struct CseWalker* const pWalker, const int entryIndex)
+{
+	const struct ValueEntry* const pEntry = &((const struct ValueEntry*)pWalker->pCtx->valueEntries.pData)[entryIndex - 1];
+	struct ValueSlot* const pSlots = (struct ValueSlot*)pWalker->pCtx->valueSlots.pData;
+	unsigned int index = HashValue(pEntry->kind, pEntry->lhs, pEntry->rhs) & (pWalker->slotCapacity - 1);
+	while(pSlots[index].generation == pWalker->generation && pSlots[index].entryIndex != 0)
+	{
+		index = (index + 1) & (pWalker->slotCapacity - 1);
+	}
+	pSlots[index].entryIndex = entryIndex;
+	pSlots[index].generation = pWalker->generation;
+	++pWalker->slotSize;
+}
+// 表が半分埋まったら広げて今の世代の値を入れ直す
+static void GrowSlots(struct CseWalker* const pWalker)
+{
+	struct MccContext* const pCtx = pWalker->pCtx;
+	if ((pWalker->slotSize + 1) * 2 <= pWalker->slotCapacity) { return; }
+
+	const int oldCapacity = pWalker->slotCapacity;
+	pWalker->slotCapacity *= 2;
+	struct ValueSlot* const pSlots = (struct ValueSlot*)ReserveBuffer(&pCtx->valueSlots, pWalker->slotCapacity, sizeof(struct ValueSlot));
+	const int generation = pWalker->generation;
+	int* const pEntryIndices = (int*)ArenaAlloc(pCtx, oldCapacity * sizeof(int));
+	int count = 0;
+	for (int i = 0; i < oldCapacity; ++i)
+	{
+		if (pSlots[i].generation == generation && pSlots[i].entryIndex != 0) { pEntryIndices[count++] = pSlots[i].entryIndex; }
+	}
+	memset(pSlots, 0, pWalker->slotCapacity * sizeof(struct ValueSlot));
+	pWalker->slotSize = 0;
+	for (int i = 0; i < count; ++i) { InsertSlot(pWalker, pEntryIndices[i]); }
+}
+// 値番号を返す．pIsFoundには今の基本ブロックで計算済みだったかを返す
+static int FindValue(struct CseWalker* const pWalker, const enum NodeKind kind, int lhs, int rhs, struct Node* const pNode, bool* const pIsFound)
+{
+	struct MccContext* const pCtx = pWalker->pCtx;
+	if (IsCommutative(kind) && lhs > rhs)
+	{
+		const int tmp = lhs;
+		lhs = rhs;
+		rhs = tmp;
+	}
+
+	const struct ValueSlot* const pSlots = (const struct ValueSlot*)pCtx->valueSlots.pData;
+	const struct ValueEntry* const pEntries = (const struct ValueEntry*)pCtx->valueEntries.pData;
+	unsigned int index = HashValue(kind, lhs, rhs) & (pWalker->slotCapacity - 1);
+	while(pSlots[index].generation == pWalker->generation && pSlots[index].entryIndex != 0)
+	{
+		const struct ValueEntry* const pEntry = &pEntries[pSlots[index].entryIndex - 1];
+		if (pEntry->kind == (int)kind && pEntry->lhs == lhs && pEntry->rhs == rhs)
+		{
+			*pIsFound = true;
+			return pSlots[index].entryIndex;
+		}
+		index = (index + 1) & (pWalker->slotCapacity - 1);
+	}
+
+	struct ValueEntry* const pNewEntries = (struct ValueEntry*)ReserveBuffer(&pCtx->valueEntries, pWalker->entrySize + 1, sizeof(struct ValueEntry));
+	struct ValueEntry* const pEntry = &pNewEntries[pWalker->entrySize++];
+	pEntry->kind = kind;
+	pEntry->lhs = lhs;
+	pEntry->rhs = rhs;
+	pEntry->pFirst = pNode;
+	pEntry->pHolder = NULL;
+	pEntry->holderVersion = 0;
+	pEntry->pTemp = NULL;
+	GrowSlots(pWalker);
+	InsertSlot(pWalker, pWalker->entrySize);
+	*pIsFound = false;
+	return pWalker->entrySize;
+}
+static struct ValueEntry* GetValueEntry(const struct CseWalker* const pWalker, const int valueNumber)
+{
+	assert(valueNumber > 0 && valueNumber <= pWalker->entrySize);
+	return &((struct ValueEntry*)pWalker->pCtx->valueEntries.pData)[valueNumber - 1];
+}
+static bool IsHolderAlive(const struct CseWalker* const pWalker, const struct ValueEntry* const pEntry)
+{
+	return (pEntry->pHolder != NULL && pWalker->pVersions[pEntry->pHolder->index] == pEntry->holderVersion);
+}
+static void AddValueUse(struct CseWalker* const pWalker, struct Node* const pNode, struct LocalVar* const pHolder)
+{
+	struct ValueUse* const pUses = (struct ValueUse*)ReserveBuffer(&pWalker->pCtx->valueUses, pWalker->useSize + 1, sizeof(struct ValueUse));
+	pUses[pWalker->useSize].pNode = pNode;
+	pUses[pWalker->useSize].pHolder = pHolder;
+	++pWalker->useSize;
+}
+
+// 式を評価順にたどって値番号を付ける(代入と関数呼び出しを含む式には付けない)
+static void NumberExpr(struct CseWalker* const pWalker, struct Node* const pRoot)
+{
+	struct MccContext* const pCtx = pWalker->pCtx;
+	int size = 0;
+	struct GenWork* pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, 1, sizeof(struct GenWork));
+	pWorks[size].pNode = pRoot;
+	pWorks[size++].phase = 0;
+
+	while(size > 0)
+	{
+		const struct GenWork work = pWorks[--size];
+		struct Node* const pNode = (struct Node*)work.pNode;
+		bool isFound = false;
+
+		if (work.phase == 0)
+		{
+			switch(pNode->kind)
+			{
+				case ND_LVAR:
+					pNode->valueNumber = FindValue(pWalker, ND_LVAR, pNode->pLVar->index, pWalker->pVersions[pNode->pLVar->index], pNode, &isFound);
+					continue;
+				case ND_NUM:
+					pNode->valueNumber = FindValue(pWalker, ND_NUM, pNode->value, 0, pNode, &isFound);
+					continue;
+				case ND_FUNC:
+					pNode->valueNumber = 0;
+					ClearValues(pWalker);
+					continue;
+				default:
+					break;
+			}
+			pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, size + 3, sizeof(struct GenWork));
+			pWorks[size].pNode = pNode;
+			pWorks[size++].phase = 1;
+			pWorks[size].pNode = pNode->pRhs;
+			pWorks[size++].phase = 0;
+			if (pNode->kind != ND_ASSIGN)
+			{
+				pWorks[size].pNode = pNode->pLhs;
+				pWorks[size++].phase = 0;
+			}
+			continue;
+		}
+
+		pNode->valueNumber = 0;
+		if (pNode->kind == ND_ASSIGN)
+		{
+			if (pNode->pLhs->kind != ND_LVAR) { continue; }
+			struct LocalVar* const pLVar = pNode->pLhs->pLVar;
+			const int version = ++pWalker->pVersions[pLVar->index];
+			// 8Byte変数は代入した値をそのまま持つので，次からはその変数を読めばよい
+			if (pNode->pRhs->valueNumber > 0 && pLVar->size == 8)
+			{
+				struct ValueEntry* const pEntry = GetValueEntry(pWalker, pNode->pRhs->valueNumber);
+				if (!IsHolderAlive(pWalker, pEntry))
+				{
+					pEntry->pHolder = pLVar;
+					pEntry->holderVersion = version;
+				}
+			}
+			continue;
+		}
+
+		if (pNode->pLhs->valueNumber <= 0 || pNode->pRhs->valueNumber <= 0) { continue; }
+		pNode->valueNumber = FindValue(pWalker, pNode->kind, pNode->pLhs->valueNumber, pNode->pRhs->valueNumber, pNode, &isFound);
+		if (isFound)
+		{
+			const struct ValueEntry* const pEntry = GetValueEntry(pWalker, pNode->valueNumber);
+			AddValueUse(pWalker, pNode, IsHolderAlive(pWalker, pEntry) ? pEntry->pHolder : NULL);
+		}
+	}
+}
+static void NumberStmt(struct CseWalker* const pWalker, struct Node* const pNode)
+{
+	switch(pNode->kind)
+	{
+		case ND_RTN:
+			NumberExpr(pWalker, pNode->pLhs);
+			ClearValues(pWalker);
+			return;
+		case ND_IF:
+			NumberExpr(pWalker, pNode->pCond);
+			ClearValues(pWalker);
+			NumberStmt(pWalker, pNode->pThen);
+			ClearValues(pWalker);
+			if (pNode->pElse != NULL) { NumberStmt(pWalker, pNode->pElse); }
+			ClearValues(pWalker);
+			return;
+		case ND_WHILE:
+			// 条件は毎周回評価される別の基本ブロック
+			ClearValues(pWalker);
+			NumberExpr(pWalker, pNode->pCond);
+			ClearValues(pWalker);
+			NumberStmt(pWalker, pNode->pThen);
+			ClearValues(pWalker);
+			return;
+		case ND_BLOCK:
+			for (struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext) { NumberStmt(pWalker, pTmp); }
+			return;
+		case ND_SWITCH:
+			NumberExpr(pWalker, pNode->pCond);
+			ClearValues(pWalker);
+			NumberStmt(pWalker, pNode->pThen);
+			ClearValues(pWalker);
+			return;
+		case ND_CASE:
+		case ND_DEFAULT:
+			// 飛び込まれる位置
+			ClearValues(pWalker);
+			NumberStmt(pWalker, pNode->pThen);
+			return;
+		case ND_BREAK:
+			ClearValues(pWalker);
+			return;
+		default:
+			NumberExpr(pWalker, pNode);
+			return;
+	}
+}
+
+// 置き換えで評価されなくなった部分木に印を付ける
+static void DiscardSubtree(struct MccContext* const pCtx, struct Node* const pRoot)
+{
+	int size = 0;
+	struct GenWork* pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, 1, sizeof(struct GenWork));
+	pWorks[size].pNode = pRoot;
+	pWorks[size++].phase = 0;
+	while(size > 0)
+	{
+		struct Node* const pNode = (struct Node*)pWorks[--size].pNode;
+		pNode->valueNumber = -1;
+		pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, size + 2, sizeof(struct GenWork));
+		if (pNode->pLhs != NULL) { pWorks[size].pNode = pNode->pLhs; pWorks[size++].phase = 0; }
+		if (pNode->pRhs != NULL) { pWorks[size].pNode = pNode->pRhs; pWorks[size++].phase = 0; }
+	}
+}
+// 最初の式を一時変数への代入にして値を残す
+static struct LocalVar* KeepValue(struct MccContext* const pCtx, struct ValueEntry* const pEntry)
+{
+	if (pEntry->pTemp != NULL) { return pEntry->pTemp; }
+
+	struct Node* const pFirst = pEntry->pFirst;
+	struct Node* const pValue = CreateNewNode(pCtx);
+	*pValue = *pFirst;
+	struct Node* const pTemp = CreateNewNode(pCtx);
+	SetNode(&(*pTemp), ND_LVAR, NULL, NULL, 0);
+	pTemp->pLVar = CreateLocalVar(pCtx, "", 0, 8/*Bytes*/);
+	SetNode(&(*pFirst), ND_ASSIGN, pTemp, pValue, 0);
+	pFirst->valueNumber = 0;
+
+	pEntry->pTemp = pTemp->pLVar;
+	return pEntry->pTemp;
+}
+void EliminateCommonSubexpressions(struct MccContext* const pCtx, struct Node* const pProgram)
+{
+	struct CseWalker walker;
+	walker.pCtx = pCtx;
+	walker.entrySize = 0;
+	walker.slotCapacity = 64;
+	walker.slotSize = 0;
+	walker.generation = 1;
+	walker.useSize = 0;
+	walker.pVersions = (int*)ReserveBuffer(&pCtx->lvarVersions, pCtx->lvarMemoryCount + 1, sizeof(int));
+	memset(walker.pVersions, 0, (pCtx->lvarMemoryCount + 1) * sizeof(int));
+	memset(ReserveBuffer(&pCtx->valueSlots, walker.slotCapacity, sizeof(struct ValueSlot)), 0, walker.slotCapacity * sizeof(struct ValueSlot));
+
+	for (struct Node* pCode = pProgram; pCode != NULL; pCode = pCode->pNext) { NumberStmt(&walker, pCode); }
+
+	// 後ろから処理すると外側の式が内側より先に来る
+	const struct ValueUse* const pUses = (const struct ValueUse*)pCtx->valueUses.pData;
+	for (int i = walker.useSize - 1; i >= 0; --i)
+	{
+		struct Node* const pNode = pUses[i].pNode;
+		if (pNode->valueNumber < 0) { continue; }
+		struct ValueEntry* const pEntry = GetValueEntry(&walker, pNode->valueNumber);
+		struct LocalVar* const pHolder = (pUses[i].pHolder != NULL) ? pUses[i].pHolder : KeepValue(pCtx, pEntry);
+
+		DiscardSubtree(pCtx, pNode);
+		SetNode(&(*pNode), ND_LVAR, NULL, NULL, 0);
+		pNode->pLVar = pHolder;
+		++pCtx->stats.cseCount;
+	}
+}
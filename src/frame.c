@@ -0,0 +1,251 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// 変数の生存区間を求め，区間が重ならない変数に同じ領域を割り当てる
+// 区間は文を実行順にたどったときの参照の通し番号で表す
+// 前方への分岐(if/switch/break)は区間の途中を飛ばすだけなので通し番号の区間で足りる
+// ループの後方分岐だけは，前の周回の値を読みうる変数の区間をループ全体に広げる
+
+// ループ内で最初の参照の種類
+enum LoopState
+{
+	LS_UNSEEN, // まだ参照していない
+	LS_KILLED, // 毎周回必ず代入してから読む(周回をまたいで生きない)
+	LS_LIVE,   // 前の周回の値を読みうる
+};
+
+struct FrameWalker
+{
+	struct MccContext* pCtx;
+	int position;    // 参照の通し番号
+	int condDepth;   // if/switch/ループ本体の入れ子の深さ
+	int switchDepth; // 最も内側のループの中にあるswitchの深さ(breakの飛び先を見分ける)
+	int loopSize;
+	int lvarCount;
+};
+
+static unsigned char* GetLoopStates(const struct FrameWalker* const pWalker, const int loopIndex)
+{
+	return (unsigned char*)pWalker->pCtx->loopStates.pData + (size_t)loopIndex * pWalker->lvarCount;
+}
+// 変数の参照を記録する
+static void TouchLocalVar(struct FrameWalker* const pWalker, struct LocalVar* const pLVar, const bool isDef)
+{
+	const int position = ++pWalker->position;
+	if (pLVar->begin < 0) { pLVar->begin = position; }
+	pLVar->end = position;
+
+	const struct LoopScope* const pScopes = (const struct LoopScope*)pWalker->pCtx->loopScopes.pData;
+	for (int i = 0; i < pWalker->loopSize; ++i)
+	{
+		unsigned char* const pState = &GetLoopStates(pWalker, i)[pLVar->index];
+		if (*pState != LS_UNSEEN) { continue; }
+		const bool isEveryTime = (pWalker->condDepth <= pScopes[i].bodyDepth) && !pScopes[i].isBreakSeen;
+		*pState = (isDef && isEveryTime) ? LS_KILLED : LS_LIVE;
+	}
+}
+// 式を評価順にたどる(代入は右辺を読んでから左辺に書く)
+static void WalkExpr(struct FrameWalker* const pWalker, const struct Node* const pNode)
+{
+	struct MccContext* const pCtx = pWalker->pCtx;
+	int size = 0;
+	struct GenWork* pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, 1, sizeof(struct GenWork));
+	pWorks[size].pNode = pNode;
+	pWorks[size++].phase = 0;
+
+	while(size > 0)
+	{
+		const struct GenWork work = pWorks[--size];
+		const struct Node* const pCur = work.pNode;
+		if (work.phase != 0)
+		{
+			// 代入の書き込み
+			if (pCur->pLhs->kind == ND_LVAR) { TouchLocalVar(pWalker, pCur->pLhs->pLVar, true); }
+			continue;
+		}
+
+		switch(pCur->kind)
+		{
+			case ND_LVAR:
+				TouchLocalVar(pWalker, pCur->pLVar, false);
+				continue;
+			case ND_NUM:
+			case ND_FUNC:
+				continue;
+			default:
+				break;
+		}
+
+		pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, size + 3, sizeof(struct GenWork));
+		if (pCur->kind == ND_SELECT)
+		{
+			// 条件，真の値，偽の値の順(両方の値を読む)
+			pWorks[size].pNode = pCur->pRhs;
+			pWorks[size++].phase = 0;
+			pWorks[size].pNode = pCur->pLhs;
+			pWorks[size++].phase = 0;
+			pWorks[size].pNode = pCur->pCond;
+			pWorks[size++].phase = 0;
+		}
+		else if (pCur->kind == ND_ASSIGN)
+		{
+			pWorks[size].pNode = pCur;
+			pWorks[size++].phase = 1;
+			pWorks[size].pNode = pCur->pRhs;
+			pWorks[size++].phase = 0;
+		}
+		else
+		{
+			pWorks[size].pNode = pCur->pRhs;
+			pWorks[size++].phase = 0;
+			pWorks[size].pNode = pCur->pLhs;
+			pWorks[size++].phase = 0;
+		}
+	}
+}
+static void WalkStmt(struct FrameWalker* const pWalker, const struct Node* const pNode);
+static void WalkLoop(struct FrameWalker* const pWalker, const struct Node* const pNode)
+{
+	struct MccContext* const pCtx = pWalker->pCtx;
+	const int loopIndex = pWalker->loopSize++;
+	struct LoopScope* pScopes = (struct LoopScope*)ReserveBuffer(&pCtx->loopScopes, pWalker->loopSize, sizeof(struct LoopScope));
+	pScopes[loopIndex].begin = ++pWalker->position;
+	pScopes[loopIndex].bodyDepth = pWalker->condDepth + 1;
+	pScopes[loopIndex].isBreakSeen = false;
+	ReserveBuffer(&pCtx->loopStates, pWalker->loopSize * pWalker->lvarCount, sizeof(unsigned char));
+	memset(GetLoopStates(pWalker, loopIndex), LS_UNSEEN, pWalker->lvarCount);
+
+	// 条件は毎周回必ず評価される
+	const int outerSwitchDepth = pWalker->switchDepth;
+	pWalker->switchDepth = 0;
+	WalkExpr(pWalker, pNode->pCond);
+	++pWalker->condDepth;
+	WalkStmt(pWalker, pNode->pThen);
+	--pWalker->condDepth;
+	pWalker->switchDepth = outerSwitchDepth;
+
+	// 前の周回の値を読みうる変数はループ全体で生きている
+	const int end = ++pWalker->position;
+	const int begin = ((struct LoopScope*)pCtx->loopScopes.pData)[loopIndex].begin;
+	const unsigned char* const pStates = GetLoopStates(pWalker, loopIndex);
+	for (struct LocalVar* pLVar = pCtx->firstLVar.next; pLVar != NULL; pLVar = pLVar->next)
+	{
+		if (pStates[pLVar->index] != LS_LIVE) { continue; }
+		if (pLVar->begin > begin) { pLVar->begin = begin; }
+		if (pLVar->end < end) { pLVar->end = end; }
+	}
+	--pWalker->loopSize;
+}
+static void WalkStmt(struct FrameWalker* const pWalker, const struct Node* const pNode)
+{
+	switch(pNode->kind)
+	{
+		case ND_RTN:
+			WalkExpr(pWalker, pNode->pLhs);
+			return;
+		case ND_IF:
+			WalkExpr(pWalker, pNode->pCond);
+			++pWalker->condDepth;
+			WalkStmt(pWalker, pNode->pThen);
+			if (pNode->pElse != NULL) { WalkStmt(pWalker, pNode->pElse); }
+			--pWalker->condDepth;
+			return;
+		case ND_WHILE:
+			WalkLoop(pWalker, pNode);
+			return;
+		case ND_BLOCK:
+			for (const struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext) { WalkStmt(pWalker, pTmp); }
+			return;
+		case ND_SWITCH:
+			WalkExpr(pWalker, pNode->pCond);
+			++pWalker->condDepth;
+			++pWalker->switchDepth;
+			WalkStmt(pWalker, pNode->pThen);
+			--pWalker->switchDepth;
+			--pWalker->condDepth;
+			return;
+		case ND_CASE:
+		case ND_DEFAULT:
+			WalkStmt(pWalker, pNode->pThen);
+			return;
+		case ND_BREAK:
+			// ループを抜けるbreakより後の参照は毎周回実行されるとは限らない
+			if (pWalker->switchDepth == 0 && pWalker->loopSize > 0)
+			{
+				((struct LoopScope*)pWalker->pCtx->loopScopes.pData)[pWalker->loopSize - 1].isBreakSeen = true;
+			}
+			return;
+		default:
+			WalkExpr(pWalker, pNode);
+			return;
+	}
+}
+
+// 生存区間の始まり順(同じなら宣言順)
+static int CompareLocalVarBegin(const void* pA, const void* pB)
+{
+	const struct LocalVar* const pLVarA = *(const struct LocalVar* const*)pA;
+	const struct LocalVar* const pLVarB = *(const struct LocalVar* const*)pB;
+	if (pLVarA->begin != pLVarB->begin) { return (pLVarA->begin > pLVarB->begin) - (pLVarA->begin < pLVarB->begin); }
+	return (pLVarA->index > pLVarB->index) - (pLVarA->index < pLVarB->index);
+}
+// 変数のオフセットとフレームの大きさを決める
+// int(4Byte)は4Byte境界に詰め，同じ大きさで区間が終わった領域があれば使い回す
+void AllocateLocalVars(struct MccContext* const pCtx, struct Node* const pProgram)
+{
+	struct FrameWalker walker;
+	walker.pCtx = pCtx;
+	walker.position = 0;
+	walker.condDepth = 0;
+	walker.switchDepth = 0;
+	walker.loopSize = 0;
+	walker.lvarCount = pCtx->lvarMemoryCount;
+	for (const struct Node* pCode = pProgram; pCode != NULL; pCode = pCode->pNext) { WalkStmt(&walker, pCode); }
+
+	// 参照された変数だけを区間の始まり順に並べる
+	int lvarSize = 0;
+	struct LocalVar** const pLVars = (struct LocalVar**)ReserveBuffer(&pCtx->frameVars, walker.lvarCount + 1, sizeof(struct LocalVar*));
+	for (struct LocalVar* pLVar = pCtx->firstLVar.next; pLVar != NULL; pLVar = pLVar->next)
+	{
+		if (pLVar->begin >= 0) { pLVars[lvarSize++] = pLVar; }
+	}
+	qsort(pLVars, lvarSize, sizeof(struct LocalVar*), CompareLocalVarBegin);
+
+	int frameSize = 0;
+	int slotSize = 0;
+	struct FrameSlot* pSlots = (struct FrameSlot*)ReserveBuffer(&pCtx->frameSlots, lvarSize + 1, sizeof(struct FrameSlot));
+	for (int i = 0; i < lvarSize; ++i)
+	{
+		struct LocalVar* const pLVar = pLVars[i];
+		struct FrameSlot* pSlot = NULL;
+		for (int j = 0; pCtx->option.isStackReuse && j < slotSize; ++j)
+		{
+			if (pSlots[j].size == pLVar->size && pSlots[j].busyUntil < pLVar->begin) { pSlot = &pSlots[j]; break; }
+		}
+		if (pSlot == NULL)
+		{
+			frameSize = (frameSize + pLVar->size + pLVar->size - 1) / pLVar->size * pLVar->size;
+			pSlot = &pSlots[slotSize++];
+			pSlot->offset = frameSize;
+			pSlot->size = pLVar->size;
+		}
+		pSlot->busyUntil = pLVar->end;
+		pLVar->offset = pSlot->offset;
+	}
+
+	// rspは16Byte境界を保つ
+	pCtx->frameSize = (frameSize + 15) / 16 * 16;
+	pCtx->stats.frameSize = pCtx->frameSize;
+	pCtx->stats.legacyFrameSize = (walker.lvarCount * 8 + 15) / 16 * 16;
+	pCtx->stats.lvarCount = walker.lvarCount;
+	pCtx->stats.slotCount = slotSize;
+}
@@ -1,2 +1,4 @@
 #include <stdio.h>
 void foo() { printf("OK\n"); }
+// 呼び出しのベンチマーク用: 呼ばれた回数を返す
+int tick() { static int count = 0; return ++count; }
@@ -0,0 +1,204 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// 分岐の除去(if変換)
+// 対象: if (A) x = B; else x = C;  ->  x = A ? B : C (ND_SELECT, cmovで選ぶ)
+//       if (A) x = B;              ->  x = A ? B : x
+//       if (A) x = 1; else x = 0;  ->  x = (A != 0) (setccで求める)
+// B/Cは両方とも評価するので，副作用がなく例外も起こさない(除算を含まない)小さな式に限る
+// プロファイルで偏りがわかっている分岐は予測が当たるので変換しない
+// 腕が1つの形は条件が偽のときの文の値(rax)が変わるので，mainの最後に実行されうる文では変換しない
+
+#define SELECT_MAX_COST 8   // 両腕の値のノード数の合計の上限(投機的に評価する量)
+#define SELECT_BIAS_RATIO 8 // 少ない側の回数がこの分の1以下なら分岐のままにする
+
+static struct Node* NewNode(struct MccContext* const pCtx, const enum NodeKind kind, struct Node* const pLhs, struct Node* const pRhs, const int value)
+{
+	struct Node* const pNode = CreateNewNode(pCtx);
+	SetNode(&(*pNode), kind, pLhs, pRhs, value);
+	return pNode;
+}
+static bool IsCompareNode(const struct Node* const pNode)
+{
+	return (pNode->kind == ND_EQU || pNode->kind == ND_NEQ || pNode->kind == ND_LTH || pNode->kind == ND_LEQ);
+}
+
+// 投機的に評価してよい式ならノード数を返す(だめなとき，budgetを超えたときは-1)
+static int GetSpeculationCost(const struct Node* const pNode, const int budget)
+{
+	if (budget <= 0) { return -1; }
+	switch(pNode->kind)
+	{
+		case ND_NUM:
+		case ND_LVAR:
+			return 1;
+		case ND_ADD:
+		case ND_SUB:
+		case ND_MUL:
+		case ND_EQU:
+		case ND_NEQ:
+		case ND_LTH:
+		case ND_LEQ:
+		{
+			const int lhsCost = GetSpeculationCost(pNode->pLhs, budget - 1);
+			if (lhsCost < 0) { return -1; }
+			const int rhsCost = GetSpeculationCost(pNode->pRhs, budget - 1 - lhsCost);
+			if (rhsCost < 0) { return -1; }
+			return 1 + lhsCost + rhsCost;
+		}
+		default:
+			return -1; // 代入/関数呼び出し/0除算しうる除算
+	}
+}
+// 腕が変数への代入1つならその代入を返す
+static struct Node* GetSingleAssign(struct Node* pArm)
+{
+	while(pArm != NULL && pArm->kind == ND_BLOCK)
+	{
+		if (pArm->pBlock == NULL || pArm->pBlock->pNext != NULL) { return NULL; }
+		pArm = pArm->pBlock;
+	}
+	if (pArm == NULL || pArm->kind != ND_ASSIGN || pArm->pLhs->kind != ND_LVAR) { return NULL; }
+	return pArm;
+}
+// プロファイルで片方の腕に偏っている(一度も実行されていない場合も含む)
+static bool IsBiased(const struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	if (!pCtx->option.isProfileUse || !pNode->hasProfile) { return false; }
+	const long long thenCount = pNode->profTaken;
+	const long long elseCount = pNode->profEntry - pNode->profTaken;
+	const long long minority = (thenCount < elseCount) ? thenCount : elseCount;
+	const long long majority = (thenCount < elseCount) ? elseCount : thenCount;
+	return (minority * SELECT_BIAS_RATIO <= majority);
+}
+// 条件が真なら1，偽なら0になる式(isInvertなら逆)
+static struct Node* CreateBoolean(struct MccContext* const pCtx, struct Node* const pCond, const bool isInvert)
+{
+	if (IsCompareNode(pCond) && !isInvert) { return pCond; }
+	if (pCond->kind == ND_EQU || pCond->kind == ND_NEQ)
+	{
+		pCond->kind = (pCond->kind == ND_EQU) ? ND_NEQ : ND_EQU;
+		return pCond;
+	}
+	return NewNode(pCtx, isInvert ? ND_EQU : ND_NEQ, pCond, NewNode(pCtx, ND_NUM, NULL, NULL, 0), 0);
+}
+static bool IsNumber(const struct Node* const pNode, const int value)
+{
+	return (pNode->kind == ND_NUM && pNode->value == value);
+}
+
+// ifを分岐のない代入に置き換える(置き換えたらtrue)
+static bool ConvertIf(struct MccContext* const pCtx, struct Node* const pNode, const bool isTail)
+{
+	struct Node* const pThen = GetSingleAssign(pNode->pThen);
+	if (pThen == NULL) { return false; }
+	struct Node* pElse = NULL;
+	if (pNode->pElse != NULL)
+	{
+		pElse = GetSingleAssign(pNode->pElse);
+		if (pElse == NULL || pElse->pLhs->pLVar != pThen->pLhs->pLVar) { return false; }
+	}
+	else if (isTail)
+	{
+		return false;
+	}
+
+	const int thenCost = GetSpeculationCost(pThen->pRhs, SELECT_MAX_COST);
+	if (thenCost < 0) { return false; }
+	const int elseCost = (pElse != NULL) ? GetSpeculationCost(pElse->pRhs, SELECT_MAX_COST - thenCost) : 1;
+	if (elseCost < 0 || thenCost + elseCost > SELECT_MAX_COST) { return false; }
+	if (IsBiased(pCtx, pNode)) { return false; }
+
+	struct Node* pValue = NULL;
+	if (pElse != NULL && IsNumber(pThen->pRhs, 1) && IsNumber(pElse->pRhs, 0))
+	{
+		pValue = CreateBoolean(pCtx, pNode->pCond, false);
+	}
+	else if (pElse != NULL && IsNumber(pThen->pRhs, 0) && IsNumber(pElse->pRhs, 1))
+	{
+		pValue = CreateBoolean(pCtx, pNode->pCond, true);
+	}
+	else
+	{
+		// 腕が1つなら偽のときは今の値をそのまま書き戻す
+		struct Node* const pElseValue = (pElse != NULL) ? pElse->pRhs : NewNode(pCtx, ND_LVAR, NULL, NULL, 0);
+		if (pElse == NULL) { pElseValue->pLVar = pThen->pLhs->pLVar; }
+		pValue = NewNode(pCtx, ND_SELECT, pThen->pRhs, pElseValue, 0);
+		pValue->pCond = pNode->pCond;
+	}
+
+	// 文の並び(pNext)を保つためにifのノードをそのまま代入にする
+	SetNode(&(*pNode), ND_ASSIGN, pThen->pLhs, pValue, 0);
+	pNode->pCond = NULL;
+	pNode->pThen = NULL;
+	pNode->pElse = NULL;
+	++pCtx->stats.ifConversionCount;
+	return true;
+}
+
+// コードを出さない文か(空のブロック，初期化のない宣言も空のブロックになる)
+static bool IsEmptyStmt(const struct Node* const pNode)
+{
+	if (pNode->kind != ND_BLOCK) { return false; }
+	for (const struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext)
+	{
+		if (!IsEmptyStmt(pTmp)) { return false; }
+	}
+	return true;
+}
+// この文の後にraxを書き換える文がないか(breakはraxを書き換えずに抜ける)
+static bool IsLastStmt(const struct Node* const pNode)
+{
+	for (const struct Node* pTmp = pNode->pNext; pTmp != NULL; pTmp = pTmp->pNext)
+	{
+		if (pTmp->kind == ND_BREAK) { return true; }
+		if (!IsEmptyStmt(pTmp))     { return false; }
+	}
+	return true;
+}
+
+// 文を再帰的にたどる(isTail: この文の後にraxを書き換えずにmainを抜けうる)
+static void ConvertStmt(struct MccContext* const pCtx, struct Node* const pNode, const bool isTail);
+static void ConvertStmtList(struct MccContext* const pCtx, struct Node* const pFirst, const bool isTail)
+{
+	for (struct Node* pNode = pFirst; pNode != NULL; pNode = pNode->pNext)
+	{
+		ConvertStmt(pCtx, pNode, isTail && IsLastStmt(pNode));
+	}
+}
+static void ConvertStmt(struct MccContext* const pCtx, struct Node* const pNode, const bool isTail)
+{
+	switch(pNode->kind)
+	{
+		case ND_IF:
+			if (ConvertIf(pCtx, pNode, isTail)) { return; }
+			ConvertStmt(pCtx, pNode->pThen, isTail);
+			if (pNode->pElse != NULL) { ConvertStmt(pCtx, pNode->pElse, isTail); }
+			return;
+		case ND_BLOCK:
+			ConvertStmtList(pCtx, pNode->pBlock, isTail);
+			return;
+		case ND_WHILE:
+		case ND_SWITCH:
+		case ND_CASE:
+		case ND_DEFAULT:
+			// 本体からbreakで抜けうるので本体の最後の文も末尾とみなす
+			ConvertStmt(pCtx, pNode->pThen, isTail);
+			return;
+		default:
+			return;
+	}
+}
+void ConvertIfs(struct MccContext* const pCtx, struct Node* const pProgram)
+{
+	ConvertStmtList(pCtx, pProgram, true);
+}
@@ -1,3 +1,12 @@
+#ifndef MCC_H
+#define MCC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
 // -- DEFINE --
 // トークン: 単語
 enum TokenKind
@@ -14,6 +23,11 @@ enum TokenKind
 	TK_IF,
 	TK_ELSE,
 	TK_WHILE,
+	TK_SWITCH,
+	TK_CASE,
+	TK_DEFAULT,
+	TK_BREAK,
+	TK_INT,
 };
 
 struct Token
@@ -54,6 +68,13 @@ enum NodeKind
 	ND_BLOCK,
 
 	ND_FUNC,
+
+	ND_SWITCH,
+	ND_CASE,
+	ND_DEFAULT,
+	ND_BREAK,
+
+	ND_SELECT, // pCond ? pLhs : pRhs (if変換で作る．両辺とも評価する)
 };
 
 struct Node
@@ -62,18 +83,37 @@ struct Node
 	struct Node* pLhs;
 	struct Node* pRhs;
 	int value;  // kind == ND_NUM
-	int offset; // kind == ND_LVAR
+	struct LocalVar* pLVar; // kind == ND_LVAR
 
 	// if-else/while
 	struct Node* pCond; // 条件
 	struct Node* pThen; // 条件後の処理
 	struct Node* pElse; // elseの処理
 
-	struct Node* pBlock;
-	int isReadBlock;
+	struct Node* pBlock; // ブロックの先頭の文
+	struct Node* pNext;  // ブロック内の次の文
+
+	// switch/case
+	struct Node* pCaseNext; // switch: 最初のcase, case: 次のcase (所有しない)
+	struct Node* pDefault;  // switch: default (所有しない)
+	int labelIndex;         // case/default: ジャンプ先ラベル番号
+
+	// プロファイル(if/while)
+	int srcPos;           // 入力先頭からの位置．プロファイルのキー
+	int hasProfile;
+	long long profEntry;  // 実行された回数
+	long long profTaken;  // if: thenの実行回数, while: 本体の実行回数(後方分岐)
 
 	const char* pLabel;
 	int labelLen;
+
+	// Sethi-Ullman
+	int suLabel;       // 評価に必要なスタック段数
+	int hasSideEffect; // 代入/関数呼び出しを含む
+	int isRhsFirst;    // 右辺から評価する
+
+	// 共通部分式の削除
+	int valueNumber; // 値番号(0はなし, -1は取り除いた部分木)
 };
 
 // ローカル変数
@@ -82,49 +122,367 @@ struct LocalVar
 	struct LocalVar *next;
 	const char* name; // 変数名
 	int len;
-	int offset;       // rbpからのオフセット
+	int size;         // 4: int, 8: 宣言なし
+	int offset;       // rbpからのオフセット(AllocateLocalVarsで決める)
+
+	// 生存区間: 参照の通し番号(未参照は-1)
+	int index;
+	int begin;
+	int end;
+};
+
+// コンパイルオプション
+struct Option
+{
+	bool isProfileGenerate; // -fprofile-generate: 分岐カウンタを埋め込む
+	bool isProfileUse;      // -fprofile-use: プロファイルから配置を決める
+	const char* pProfilePath;
+	bool isStackReuse; // 生存区間が重ならない変数でスタックの領域を共有する
+	bool isCse;        // 基本ブロック内の共通部分式を1度だけ計算する
+	int scanLevel;     // enum ScanLevel: トークナイザの走査に使う命令セット(CPUが対応していなければ落とす)
+	bool isRotateLoops; // whileを入口で1度判定するdo-while形にする
+	int loopAlign;      // ループ先頭を揃えるバイト数(2の冪, 1は揃えない)
+	int unrollFactor;   // 回数の決まったループを何周分並べるか(1は展開しない)
+	bool isOmitFramePointer; // 変数をrsp基準で指し，rbpを使わない
+	bool isIfConversion;     // 小さなif-elseを分岐のないcmov/setccにする
+	bool isCcp;              // 変数を通して定数/コピーを伝播し，通らない分岐を取り除く
+	bool isIsel;             // 定数/変数を即値/メモリオペランドとして命令に埋め込む
+};
+
+// トークナイザの走査(空白/識別子/数字の連続の長さを返す)
+enum ScanLevel
+{
+	SCAN_SCALAR,
+	SCAN_SSE2,
+	SCAN_AVX2,
+};
+#define SCAN_PADDING 64 // 入力のNULの後ろに確保しておく大きさ(SIMDの読み過ぎ分)
+struct Scanner
+{
+	const char* name;
+	size_t (*SkipSpaces)(const char* const pStr);
+	size_t (*ScanLower)(const char* const pStr);  // a-z
+	size_t (*ScanDigits)(const char* const pStr); // 0-9
+};
+
+// プロファイルのカウンタ種別
+enum ProfileArm
+{
+	PROF_ENTRY, // if/whileに到達した回数
+	PROF_TAKEN, // if: thenの実行回数, while: 後方分岐の回数
+};
+
+// アリーナ: トークン/ノード/変数をまとめて確保し，コンパイルごとに一括で返す
+struct ArenaBlock
+{
+	struct ArenaBlock* next;
+	size_t size;
+	size_t used;
+	// この後ろにデータが続く
+};
+struct Arena
+{
+	struct ArenaBlock* pHead;    // 最初のブロック
+	struct ArenaBlock* pCurrent; // 確保中のブロック
+	size_t allocSize;            // このコンパイルで確保した量(統計用)
+};
+
+// 伸長可能な配列(コンテキストが所有し，コンパイルをまたいで使い回す)
+struct Buffer
+{
+	void* pData;
+	int capacity; // 要素数
+};
+
+// 出力バッファ
+struct OutBuffer
+{
+	char* pData;
+	size_t size;
+	size_t capacity;
+};
+
+// コード生成の作業(式の評価順を作業スタックで管理する)
+struct GenWork
+{
+	const struct Node* pNode;
+	int phase;
+	int dest; // enum GenDest(コード生成のみ)
+};
+// 式の値の置き場所
+enum GenDest
+{
+	GD_STACK, // 積む
+	GD_RAX,   // raxに残す
+	GD_NONE,  // 使わない(捨てられる式文の値)
+};
+// 関数の後ろに追い出したifの腕
+struct ColdBlock
+{
+	const struct Node* pNode; // ND_IF
+	bool isThen;
+	int labelIndex;
+	int breakIndex;
+};
+// スタック上の変数領域
+struct FrameSlot
+{
+	int offset;
+	int size;
+	int busyUntil; // 使っている変数の生存区間の終わり
+};
+// 変数の指し方
+enum FrameKind
+{
+	FRAME_RBP,      // rbpを基準にする(プロローグでrbpを積む)
+	FRAME_RSP,      // rspを基準にする(プロローグでrspを下げるだけ)
+	FRAME_RED_ZONE, // rspより下のレッドゾーンに置き，rspを動かさない
 };
+#define RED_ZONE_SIZE 128 // System V ABI: シグナル処理でも壊されないrspより下の大きさ
+// 生存区間を求めるときのループ
+struct LoopScope
+{
+	int begin;        // ループ先頭の通し番号
+	int bodyDepth;    // 本体の条件の深さ．これ以下の深さの参照は毎回実行される
+	bool isBreakSeen; // 本体の途中でループを抜けうる
+};
+// 値番号表の要素: 同じ値を計算する式
+struct ValueEntry
+{
+	int kind;                 // enum NodeKind
+	int lhs;                  // 二項演算: 左辺の値番号, ND_LVAR: 変数番号, ND_NUM: 値
+	int rhs;                  // 二項演算: 右辺の値番号, ND_LVAR: 版
+	struct Node* pFirst;      // 最初に計算する式
+	struct LocalVar* pHolder; // 値を持っている変数(代入先)
+	int holderVersion;        // その変数が値を持っている版
+	struct LocalVar* pTemp;   // 値を残すために作った一時変数
+};
+// 値番号表のハッシュ
+struct ValueSlot
+{
+	int entryIndex; // 0は空
+	int generation; // 基本ブロックごとに変わる．古いものは空とみなす
+};
+// 前に計算した値で置き換える式
+struct ValueUse
+{
+	struct Node* pNode;
+	struct LocalVar* pHolder; // 使う時点で値を持っている変数(なければ一時変数を作る)
+};
+// 定数/コピー伝播での変数/式の値
+enum PropKind
+{
+	PV_VARYING, // 不明
+	PV_CONST,   // 定数value
+	PV_COPY,    // 変数pCopyの今の値と同じ
+};
+struct PropValue
+{
+	int kind; // enum PropKind
+	int hasSideEffect;
+	long long value;
+	struct LocalVar* pCopy;
+};
+// プロファイルの1地点(if/while)
+struct ProfileSite
+{
+	int srcPos;
+	long long entry;
+	long long taken;
+};
+
+// 統計(デバッグモード stats)
+struct Stats
+{
+	int frameSize;         // スタックフレームの大きさ
+	int legacyFrameSize;   // 変数ごとに8Byteを割り当てた場合の大きさ
+	int lvarCount;
+	int slotCount;
+	int cseCount;          // 削除した共通部分式
+	int unrollCount;       // 展開したループ
+	int fullUnrollCount;   // そのうちループを残さなかったもの
+	int ifConversionCount; // 分岐をなくしたif
+	int ccpUseCount;       // 定数/元の変数に置き換えた読み出し
+	int ccpFoldCount;      // 定数に畳み込んだ式
+	int ccpBranchCount;    // 取り除いたif/while
+};
+
+// コンパイラの全状態．コンテキストごとに独立なので別スレッドで同時に使える
+struct MccContext
+{
+	struct Option option;
+	int bestScanLevel; // enum ScanLevel: このCPUで使える最も速い走査(コンテキストの作成時に1度だけ調べる)
+
+	// エラー: ErrorAtはここへ戻る
+	jmp_buf errorJump;
+	char errorMessage[512];
+
+	// 入力(NUL終端の複製)と解析結果．次のコンパイルまで有効
+	char* pSrc;
+	struct Token* pTokens;
+	struct Node* pProgram;
+
+	// メモリ
+	struct Arena arena;
+	int tokenMemoryCount;
+	int nodeMemoryCount;
+	int lvarMemoryCount;
+
+	// 解析
+	struct LocalVar firstLVar;
+	struct Node* pCurrentSwitch;
+	int breakableDepth;
+	struct Buffer exprOperands;  // struct Node*
+	struct Buffer exprOperators; // int
+
+	// スタックフレーム
+	int frameSize;
+	struct Buffer frameVars;  // struct LocalVar*
+	struct Buffer frameSlots; // struct FrameSlot
+	struct Buffer loopScopes; // struct LoopScope
+	struct Buffer loopStates; // unsigned char: ループごと変数ごとの最初の参照の種類
+
+	// 共通部分式の削除
+	struct Buffer valueEntries; // struct ValueEntry
+	struct Buffer valueSlots;   // struct ValueSlot
+	struct Buffer valueUses;    // struct ValueUse
+	struct Buffer lvarVersions; // int: 変数ごとの代入回数
+
+	// 定数/コピー伝播
+	struct Buffer propValues;    // struct PropValue: 状態ごとに変数の数だけ
+	struct Buffer propReachable; // unsigned char: 状態ごとに到達するか
+	struct Buffer propOperands;  // struct PropValue: 式の評価中の値
+
+	// コード生成
+	struct OutBuffer* pOut;
+	int stackDepth; // 生成コード上のスタック段数(push/popを数える)
+	int exprDepth;  // 式の評価で積む段数の最大(LabelNodesで求める)
+	bool hasCall;   // 関数呼び出しを含む(LabelNodesで求める)
+	bool isStmtValueUsed; // 文の値(rax)がmainの戻り値になりうる(LabelNodesで求める)
+	int frameKind;  // enum FrameKind
+	int frameTop;   // rsp基準のとき: 何も積んでいないrspから変数領域の上端までのバイト数
+	int jumpIndex;  // ラベル番号
+	int breakIndex; // breakの飛び先(.Lend番号, -1はなし)
+	struct Buffer labelNodes;   // struct Node*
+	struct Buffer labelVisited; // int
+	struct Buffer genWorks;     // struct GenWork
+	struct Buffer coldBlocks;   // struct ColdBlock
+	int coldBlockSize;
+
+	// プロファイル
+	struct Buffer counterSites; // int: カウンタを割り当てた地点(2個ずつ: entry, taken)
+	int counterSiteSize;
+	struct Buffer profileSites; // struct ProfileSite: 読み込んだプロファイル(srcPos順)
+	int profileSiteSize;
+
+	struct Stats stats;
+};
+
+// -- LIBRARY --
+enum MccResult
+{
+	MCC_OK,
+	MCC_ERROR, // メッセージは mcc_error_message()
+};
+void mcc_init_option(struct Option* const pOption);
+struct MccContext* mcc_create_context(void);
+void mcc_destroy_context(struct MccContext* const pCtx);
+enum MccResult mcc_compile(struct MccContext* const pCtx, const char* const pSrc, const size_t len, struct OutBuffer* const pOut);
+const char* mcc_error_message(const struct MccContext* const pCtx);
+void mcc_init_out_buffer(struct OutBuffer* const pOut);
+void mcc_release_out_buffer(struct OutBuffer* const pOut);
+
+// -- SERVER --
+// 要求: 長さ付き文字列(呼び出し側のカレントディレクトリ), 引数の数, 引数ごとの長さ付き文字列
+// 応答: 終了コード, 標準出力の長さ付き文字列, 標準エラーの長さ付き文字列
+// 長さと数はホストのバイト順のuint32_t．1つの接続で何度でも要求できる
+#define MCC_SOCKET_ENV "MCC_SOCKET" // ソケットの位置を変える環境変数
+#define MCC_SOCKET_PATH_MAX 108     // sockaddr_unのsun_pathの大きさ
+#define MCC_MESSAGE_MAX (64 * 1024 * 1024)
+void GetSocketPath(char* const pPath, const size_t size);
+int ConnectServer(const char* const pPath);
+bool ReadFull(const int fd, void* const pData, const size_t size);
+bool WriteFull(const int fd, const void* const pData, const size_t size);
+bool WriteString(const int fd, const char* const pData, const size_t size);
+bool ReadString(const int fd, struct OutBuffer* const pOut);
+bool SendRequest(const int fd, const char* const pWorkDir, const int argc, char* const argv[]);
+bool ReceiveResponse(const int fd, int* const pStatus, struct OutBuffer* const pStdout, struct OutBuffer* const pStderr);
+bool SendResponse(const int fd, const int status, const char* const pStdout, const size_t stdoutSize, const char* const pStderr, const size_t stderrSize);
+int RunCommand(struct MccContext* const pCtx, const char* const pWorkDir, const int argc, char* argv[], FILE* const pStdout, FILE* const pStderr);
+int RunServer(const char* const pPath);
 
 // -- Debug --
-void DebugPrintNode(const struct Node* const pNode);
-void DebugPrintTokens(const struct Token* pToken);
-void DebugPrintNode(const struct Node* const pNode);
-void DebugPrintNodes(const struct Node* const pRootNode);
+void DebugPrintTokens(FILE* const pFile, const struct Token* pToken);
+void DebugPrintNode(FILE* const pFile, const struct Node* const pNode);
+void DebugPrintNodes(FILE* const pFile, const struct Node* const pRootNode);
 
 // 本体
-void ErrorAt(const char* const loc, const char* const userInput, char* fmt, ...);
+void ErrorAt(struct MccContext* const pCtx, const char* const loc, const char* const fmt, ...);
+void Error(struct MccContext* const pCtx, const char* const fmt, ...);
 bool IsAlphabetOrNumber(const char ch);
+void* ArenaAlloc(struct MccContext* const pCtx, const size_t size);
+void ResetArena(struct Arena* const pArena);
+void ReleaseArena(struct Arena* const pArena);
+void* ReserveBuffer(struct Buffer* const pBuffer, const int count, const size_t elementSize);
+void ReleaseBuffer(struct Buffer* const pBuffer);
+void Emit(struct MccContext* const pCtx, const char* const fmt, ...);
 
 // -- Token --
 bool IsExpectedToken(const char* const op, const struct Token* const pToken);
 bool IsExpectedNumber(const struct Token* const pToken);
 bool IsExpectedIdent(const struct Token* const pToken);
 bool IsEOF(const struct Token* const pToken);
-struct Token* CreateNewToken(void);
+struct Token* CreateNewToken(struct MccContext* const pCtx);
 void SetToken(struct Token* const pToken, const enum TokenKind kind, struct Token* const pNext, const int value, const char* const pStr, const int len);
-struct Token* Tokenize(char* pStr);
-int ReleaseTokenMemory(struct Token* pToken);
+struct Token* Tokenize(struct MccContext* const pCtx, char* pStr);
+
+// -- SCAN --
+enum ScanLevel GetBestScanLevel(void);
+const struct Scanner* GetScanner(const enum ScanLevel level);
+int ParseDecimal(const char* const pStr, const size_t len);
 
 // -- NODE --
-struct Node* CreateNewNode(void);
+struct Node* CreateNewNode(struct MccContext* const pCtx);
 void SetNode(struct Node* const pNode, const enum NodeKind kind, struct Node* const pLhs, struct Node* const pRhs, const int value);
-void Program(struct Node* codes[], struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Stmt(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Expr(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Assign(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Equality(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Relational(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Add(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Mul(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Unary(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-struct Node* Primary(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar);
-int ReleaseNodeMemory(struct Node* pRootNode);
+struct Node* Program(struct MccContext* const pCtx, struct Token** pToken);
+struct Node* Stmt(struct MccContext* const pCtx, struct Token** pToken);
+struct Node* Expr(struct MccContext* const pCtx, struct Token** pToken);
+struct Node* Primary(struct MccContext* const pCtx, struct Token** pToken);
 
 // -- LOCAL VARIABLE --
+struct LocalVar* CreateLocalVar(struct MccContext* const pCtx, const char* const pName, const int len, const int size);
 const struct LocalVar* FindLocalVar(const struct LocalVar* const pFirstLVar, const struct Token* const pToken);
 struct LocalVar* GetLastLocalVar(struct LocalVar* const pFirstLVar);
-int ReleaseLocalVarMemory(struct LocalVar* pLVar);
+
+// -- CCP --
+void PropagateConstants(struct MccContext* const pCtx, struct Node* const pProgram);
+
+// -- CSE --
+void EliminateCommonSubexpressions(struct MccContext* const pCtx, struct Node* const pProgram);
+
+// -- UNROLL --
+void UnrollLoops(struct MccContext* const pCtx, struct Node* const pProgram);
+
+// -- IF CONVERSION --
+void ConvertIfs(struct MccContext* const pCtx, struct Node* const pProgram);
+
+// -- FRAME --
+void AllocateLocalVars(struct MccContext* const pCtx, struct Node* const pProgram);
 
 // -- CODE GENERATOR --
-void GenLval(const struct Node* const pNode);
-void Gen(const struct Node* const pNode);
+void LabelNodes(struct MccContext* const pCtx, struct Node* const pRootNode);
+void GenLval(struct MccContext* const pCtx, const struct Node* const pNode);
+void GenExpr(struct MccContext* const pCtx, const struct Node* const pNode, const int dest);
+void Gen(struct MccContext* const pCtx, const struct Node* const pNode);
+void GenColdBlocks(struct MccContext* const pCtx);
+void GenPrologue(struct MccContext* const pCtx);
+void GenEpilogue(struct MccContext* const pCtx);
+
+// -- PROFILE --
+int GetProfileCounterIndex(struct MccContext* const pCtx, const int srcPos);
+void GenProfileRegister(struct MccContext* const pCtx);
+void GenProfileRuntime(struct MccContext* const pCtx);
+bool LoadProfile(struct MccContext* const pCtx, const char* const pPath);
+void AttachProfile(struct MccContext* const pCtx, struct Node* const pNode);
+
+#endif
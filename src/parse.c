@@ -10,66 +10,70 @@
 
 #include "mcc.h"
 
-int tokenMemoryCount = 0;
-int nodeMemoryCount = 0;
-int lvarMemoryCount = 0;
-
 // -- DEBUG --
 // トークン構造体表示
-void DebugPrintToken(const struct Token* const pToken)
+void DebugPrintToken(FILE* const pFile, const struct Token* const pToken)
 {
-	const char array[] = {'X', 'R', 'I', 'N', 'E', 'r', 'i', 'e', 'W', '{'};
+	const char array[] = {'X', 'R', 'I', 'N', 'E', 'r', 'i', 'e', 'W', 's', 'c', 'd', 'b', 'T'};
 	assert(pToken->kind < (sizeof(array)/sizeof(const char)));
-	printf("Token Info: %p\n", pToken);
-	printf("enum : %c\n", array[pToken->kind]);
-	printf("next : %p\n", pToken->next);
-	printf("value: %d\n", pToken->value);
-	printf("str  : %s(%d)\n", pToken->str, (int)(*pToken->str));
-	printf("len  : %d\n", pToken->len);
+	fprintf(pFile, "Token Info: %p\n", pToken);
+	fprintf(pFile, "enum : %c\n", array[pToken->kind]);
+	fprintf(pFile, "next : %p\n", pToken->next);
+	fprintf(pFile, "value: %d\n", pToken->value);
+	fprintf(pFile, "str  : %s(%d)\n", pToken->str, (int)(*pToken->str));
+	fprintf(pFile, "len  : %d\n", pToken->len);
 }
-void DebugPrintTokens(const struct Token* pToken)
+void DebugPrintTokens(FILE* const pFile, const struct Token* pToken)
 {
 	while(pToken != NULL)
 	{
-		DebugPrintToken(pToken);
+		DebugPrintToken(pFile, pToken);
 		pToken = pToken->next;
 	}
 }
 // ノード構造体表示
-void DebugPrintNode(const struct Node* const pNode)
+void DebugPrintNode(FILE* const pFile, const struct Node* const pNode)
 {
-	const char array[] = {'X', '+', '-', '*', '/', 'n', 'a', 'v', '=', '!', '>', 'L', 'r', 'i' ,'w', '{', 'f'};
+	const char array[] = {'X', '+', '-', '*', '/', 'n', 'a', 'v', '=', '!', '>', 'L', 'r', 'i' ,'w', '{', 'f', 's', 'c', 'd', 'b', '?'};
 	assert(pNode->kind < (sizeof(array)/sizeof(const char)));
-	printf("Node Info: %p\n", pNode);
-	printf("kind  : %c(%d)\n", array[pNode->kind], pNode->kind);
-	printf("pLhs  : %p\n", pNode->pLhs);
-	printf("pRhs  : %p\n", pNode->pRhs);
-	printf("value : %d\n", pNode->value);
-	printf("offset: %d\n", pNode->offset);
+	fprintf(pFile, "Node Info: %p\n", pNode);
+	fprintf(pFile, "kind  : %c(%d)\n", array[pNode->kind], pNode->kind);
+	fprintf(pFile, "pLhs  : %p\n", pNode->pLhs);
+	fprintf(pFile, "pRhs  : %p\n", pNode->pRhs);
+	if (pNode->kind == ND_SELECT) { fprintf(pFile, "pCond : %p\n", pNode->pCond); }
+	fprintf(pFile, "value : %d\n", pNode->value);
+	fprintf(pFile, "offset: %d\n", (pNode->pLVar != NULL) ? pNode->pLVar->offset : 0);
 }
-void DebugPrintNodes(const struct Node* const pRootNode)
+void DebugPrintNodes(FILE* const pFile, const struct Node* const pRootNode)
 {
 	if (pRootNode == NULL) { return; }
-	DebugPrintNodes(pRootNode->pLhs);
-	DebugPrintNode(pRootNode);
-	DebugPrintNodes(pRootNode->pRhs);
+	// 選択(A ? B : C)は条件Aを先に表示する
+	if (pRootNode->kind == ND_SELECT) { DebugPrintNodes(pFile, pRootNode->pCond); }
+	DebugPrintNodes(pFile, pRootNode->pLhs);
+	DebugPrintNode(pFile, pRootNode);
+	DebugPrintNodes(pFile, pRootNode->pRhs);
 }
 
 // -- FUNCTION --
-// エラーでシバく
-void ErrorAt(const char* const loc, const char* const userInput, char* fmt, ...)
+// エラーでシバく: メッセージをコンテキストに残してmcc_compileへ戻る
+void ErrorAt(struct MccContext* const pCtx, const char* const loc, const char* const fmt, ...)
 {
 	va_list ap;
 	va_start(ap, fmt);
 
-	const int pos = (int)(loc - userInput);
-	fprintf(stderr, "%s\n", userInput);
-	fprintf(stderr, "%*s", pos, " ");
-	fprintf(stderr, "^ ");
-	fprintf(stderr, fmt, ap);
-	fprintf(stderr, "\n");
+	// 入力が長いときは位置の前後だけを示す
+	const int pos = (int)(loc - pCtx->pSrc);
+	const int begin = (pos > 40) ? pos - 40 : 0;
+	int len = 0;
+	while(len < 80 && pCtx->pSrc[begin + len] != '\0') { ++len; }
+	int size = snprintf(pCtx->errorMessage, sizeof(pCtx->errorMessage), "%.*s\n%*s^ ", len, &pCtx->pSrc[begin], pos - begin, "");
+	if (size >= 0 && size < (int)sizeof(pCtx->errorMessage))
+	{
+		vsnprintf(&pCtx->errorMessage[size], sizeof(pCtx->errorMessage) - size, fmt, ap);
+	}
+	va_end(ap);
 
-	exit(1);
+	longjmp(pCtx->errorJump, 1);
 }
 bool IsAlphabetOrNumber(const char ch)
 {
@@ -122,15 +126,14 @@ bool IsEOF(const struct Token* const pToken)
 	return (pToken->kind == TK_EOF);
 }
 // トークンを作成
-struct Token* CreateNewToken(void)
+struct Token* CreateNewToken(struct MccContext* const pCtx)
 {
-	struct Token* const pNewToken = (struct Token*)malloc(1 * sizeof(struct Token));
-	assert(pNewToken != NULL);
+	struct Token* const pNewToken = (struct Token*)ArenaAlloc(pCtx, sizeof(struct Token));
 	pNewToken->kind = TK_NONE;
 	pNewToken->value = 0;
 	pNewToken->next = NULL;
 	pNewToken->str = NULL;
-	++tokenMemoryCount;
+	++pCtx->tokenMemoryCount;
 	return pNewToken;
 }
 void SetToken(struct Token* const pToken, const enum TokenKind kind, struct Token* const pNext, const int value, const char* const pStr, const int len)
@@ -142,21 +145,56 @@ void SetToken(struct Token* const pToken, const enum TokenKind kind, struct Toke
 	pToken->str = pStr;
 	pToken->len = len;
 }
+// キーワード
+struct Keyword
+{
+	const char* str;
+	int len;
+	enum TokenKind kind;
+};
+static const struct Keyword keywords[] =
+{
+	{"return",  6, TK_RETURN},
+	{"if",      2, TK_IF},
+	{"else",    4, TK_ELSE},
+	{"while",   5, TK_WHILE},
+	{"switch",  6, TK_SWITCH},
+	{"case",    4, TK_CASE},
+	{"default", 7, TK_DEFAULT},
+	{"break",   5, TK_BREAK},
+	{"int",     3, TK_INT},
+};
+// lenは英小文字の連続の長さ．それより長いキーワードは一致しない
+static const struct Keyword* FindKeyword(const char* const pStr, const int len)
+{
+	if (IsAlphabetOrNumber(pStr[len])) { return NULL; }
+	for (int i = 0; i < (int)(sizeof(keywords)/sizeof(keywords[0])); ++i)
+	{
+		const struct Keyword* const pKeyword = &keywords[i];
+		if (pKeyword->len == len && memcmp(pStr, pKeyword->str, len) == 0)
+		{
+			return pKeyword;
+		}
+	}
+	return NULL;
+}
 // 入力文字列をトークナイズ(トークンに分解)
-struct Token* Tokenize(char* pStr)
+struct Token* Tokenize(struct MccContext* const pCtx, char* pStr)
 {
-	char* pStrFirst = pStr;
-
 	struct Token head;
 	head.next = NULL;
 	struct Token* pCurrent = &head;
+	// 連続する空白/識別子/数字はまとめて走査する(pStrの後ろにSCAN_PADDINGの余白が必要)
+	// CPUが対応していない水準を指定されたときは使える水準に落とす
+	const int scanLevel = (pCtx->option.scanLevel < pCtx->bestScanLevel) ? pCtx->option.scanLevel : pCtx->bestScanLevel;
+	const struct Scanner* const pScanner = GetScanner((enum ScanLevel)scanLevel);
 
 	while(pStr[0] != '\0')
 	{
 		// 空白文字をスキップ
 		if (isspace(pStr[0]))
 		{
-			++pStr; // 次のトークンへ
+			pStr += pScanner->SkipSpaces(pStr); // 次のトークンへ
 			continue;
 		}
 
@@ -165,7 +203,7 @@ struct Token* Tokenize(char* pStr)
 			|| memcmp(pStr, "<=", 2) == 0
 			|| memcmp(pStr, ">=", 2) == 0)
 		{
-			struct Token* const pTmp = CreateNewToken();
+			struct Token* const pTmp = CreateNewToken(pCtx);
 			SetToken(&(*pTmp), TK_RESERVED, NULL, 0, pStr, 2);
 			pCurrent->next = pTmp;
 			pCurrent = pTmp;
@@ -175,9 +213,9 @@ struct Token* Tokenize(char* pStr)
 		}
 
 		const int ch = (int)pStr[0];
-		if (strchr("+-*/()><=;{}", ch) != NULL)
+		if (strchr("+-*/()><=;{}:", ch) != NULL)
 		{
-			struct Token* const pTmp = CreateNewToken();
+			struct Token* const pTmp = CreateNewToken(pCtx);
 			SetToken(&(*pTmp), TK_RESERVED, NULL, 0, pStr, 1);
 			pCurrent->next = pTmp;
 			pCurrent = pTmp;
@@ -187,105 +225,40 @@ struct Token* Tokenize(char* pStr)
 
 		if (isdigit(ch))
 		{
-			struct Token* const pTmp = CreateNewToken();
-			const char* pOriginStr = pStr;
-			const int value = (int)strtol(pStr, &pStr, 10);
-			SetToken(&(*pTmp), TK_NUM, NULL, value, pStr, (int)(pStr-pOriginStr));
-			pCurrent->next = pTmp;
-			pCurrent = pTmp;
-			continue;
-		}
-
-		const int returnStrSize = strlen("return");
-		bool isOver = (strlen(pStr) <= returnStrSize);
-		if (!isOver && strncmp(pStr, "return", returnStrSize) == 0 && !IsAlphabetOrNumber(pStr[returnStrSize]))
-		{
-			struct Token* const pTmp = CreateNewToken();
-			SetToken(&(*pTmp), TK_RETURN, NULL, 0, pStr, returnStrSize);
+			struct Token* const pTmp = CreateNewToken(pCtx);
+			const size_t len = pScanner->ScanDigits(pStr);
+			const int value = ParseDecimal(pStr, len);
+			pStr += len;
+			SetToken(&(*pTmp), TK_NUM, NULL, value, pStr, (int)len);
 			pCurrent->next = pTmp;
 			pCurrent = pTmp;
-			pStr += returnStrSize;
-			continue;
-		}
-
-		const int ifStrSize = strlen("if");
-		isOver = (strlen(pStr) <= ifStrSize);
-		if (!isOver && strncmp(pStr, "if", ifStrSize) == 0 && !IsAlphabetOrNumber(pStr[ifStrSize]))
-		{
-			struct Token* const pTmp = CreateNewToken();
-			SetToken(&(*pTmp), TK_IF, NULL, 0, pStr, ifStrSize);
-			pCurrent->next = pTmp;
-			pCurrent = pTmp;
-			pStr += ifStrSize;
-			continue;
-		}
-
-		const int elseStrSize = strlen("else");
-		isOver = (strlen(pStr) <= elseStrSize);
-		if (!isOver && strncmp(pStr, "else", ifStrSize) == 0 && !IsAlphabetOrNumber(pStr[elseStrSize]))
-		{
-			struct Token* const pTmp = CreateNewToken();
-			SetToken(&(*pTmp), TK_ELSE, NULL, 0, pStr, elseStrSize);
-			pCurrent->next = pTmp;
-			pCurrent = pTmp;
-			pStr += elseStrSize;
-			continue;
-		}
-
-		const int whileStrSize = strlen("while");
-		isOver = (strlen(pStr) <= whileStrSize);
-		if (!isOver && strncmp(pStr, "while", whileStrSize) == 0 && !IsAlphabetOrNumber(pStr[whileStrSize]))
-		{
-			struct Token* const pTmp = CreateNewToken();
-			SetToken(&(*pTmp), TK_WHILE, NULL, 0, pStr, whileStrSize);
-			pCurrent->next = pTmp;
-			pCurrent = pTmp;
-			pStr += whileStrSize;
 			continue;
 		}
 
 		if (ch >= 'a' && ch <= 'z')
 		{
-			int i = 0;
-			while(true)
-			{
-				if (pStr[i] < 'a' || pStr[i] > 'z') break;
-				++i;
-			}
-			struct Token* const pTmp = CreateNewToken();
-			SetToken(&(*pTmp), TK_IDENT, NULL, 0, pStr, i);
+			const int i = (int)pScanner->ScanLower(pStr);
+			const struct Keyword* const pKeyword = FindKeyword(pStr, i);
+			struct Token* const pTmp = CreateNewToken(pCtx);
+			SetToken(&(*pTmp), (pKeyword != NULL) ? pKeyword->kind : TK_IDENT, NULL, 0, pStr, i);
 			pCurrent->next = pTmp;
 			pCurrent = pTmp;
 			pStr += i;
 			continue;
 		}
 
-		ErrorAt(pStr, pStrFirst, "Cannot tokenize.");
+		ErrorAt(pCtx, pStr, "Cannot tokenize.");
 	}
 
-	struct Token* const pTail = CreateNewToken();
+	struct Token* const pTail = CreateNewToken(pCtx);
 	SetToken(&(*pTail), TK_EOF, NULL, 0, pStr, 0);
 	pCurrent->next = pTail;
 	return head.next;
 }
-int ReleaseTokenMemory(struct Token* pToken)
-{
-	struct Token* pDummy = pToken;
-	while(pToken != NULL)
-	{
-		pDummy = pToken->next;
-		free(pToken);
-		pToken = pDummy;
-		--tokenMemoryCount;
-	}
-	return tokenMemoryCount;
-}
-
 // -- NODE --
-struct Node* CreateNewNode(void)
+struct Node* CreateNewNode(struct MccContext* const pCtx)
 {
-	struct Node* const pNode = (struct Node*)malloc(1 * sizeof(struct Node));
-	assert(pNode != NULL);
+	struct Node* const pNode = (struct Node*)ArenaAlloc(pCtx, sizeof(struct Node));
 	pNode->kind = ND_NONE;
 	pNode->pLhs = NULL;
 	pNode->pRhs = NULL;
@@ -293,8 +266,20 @@ struct Node* CreateNewNode(void)
 	pNode->pThen = NULL;
 	pNode->pElse = NULL;
 	pNode->pBlock = NULL;
-	pNode->isReadBlock = 0;
-	++nodeMemoryCount;
+	pNode->pNext = NULL;
+	pNode->pCaseNext = NULL;
+	pNode->pDefault = NULL;
+	pNode->pLVar = NULL;
+	pNode->valueNumber = 0;
+	pNode->labelIndex = 0;
+	pNode->srcPos = -1;
+	pNode->hasProfile = 0;
+	pNode->profEntry = 0;
+	pNode->profTaken = 0;
+	pNode->suLabel = 0;
+	pNode->hasSideEffect = 0;
+	pNode->isRhsFirst = 0;
+	++pCtx->nodeMemoryCount;
 	return pNode;
 }
 void SetNode(struct Node* const pNode, const enum NodeKind kind, struct Node* const pLhs, struct Node* const pRhs, const int value)
@@ -306,267 +291,385 @@ void SetNode(struct Node* const pNode, const enum NodeKind kind, struct Node* co
 	pNode->value = value;
 }
 // program = stmt*
-void Program(struct Node* codes[], struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+// 文はブロックと同じくpNextでつなぐ
+struct Node* Program(struct MccContext* const pCtx, struct Token** pToken)
 {
-	int i = 0;
+	struct Node head;
+	head.pNext = NULL;
+	struct Node* pLast = &head;
 	while(IsEOF(*pToken) != true)
 	{
-		codes[i] = Stmt(&(*pToken), pSrc, pFirstLVar);
-		++i;
+		pLast->pNext = Stmt(pCtx, &(*pToken));
+		pLast = pLast->pNext;
 	}
-	codes[i] = NULL;
+	return head.pNext;
 }
 // stmt = expr ";" | "{" stmt* "}" | "return" expr ";" | "if" "(" expr ")" stmt ("else" stmt)? | "while" "(" expr ")" stmt
-struct Node* Stmt(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+//      | "switch" "(" expr ")" stmt | "case" "-"? num ":" stmt | "default" ":" stmt | "break" ";"
+//      | "int" ident ("=" expr)? ";"
+struct Node* Stmt(struct MccContext* const pCtx, struct Token** pToken)
 {
 	struct Node* pNode = NULL;
-	if (IsExpectedTokenForKey(*pToken, TK_RETURN))
+	if (IsExpectedTokenForKey(*pToken, TK_INT))
 	{
 		*pToken = (*pToken)->next;
+		if (!IsExpectedIdent(*pToken)) { ErrorAt(pCtx, (*pToken)->str, "need variable name."); }
+		if (FindLocalVar(&pCtx->firstLVar, *pToken) != NULL) { ErrorAt(pCtx, (*pToken)->str, "redefinition of variable."); }
+		CreateLocalVar(pCtx, (*pToken)->str, (*pToken)->len, 4/*Bytes*/);
 
-		pNode = CreateNewNode();
-		SetNode(&(*pNode), ND_RTN, Expr(&(*pToken), pSrc, pFirstLVar), NULL, 0);
+		if (IsExpectedToken("=", (*pToken)->next))
+		{
+			// 初期化は変数名から代入式として読む
+			pNode = Expr(pCtx, &(*pToken));
+		}
+		else
+		{
+			// 宣言だけなら何も生成しない空のブロック
+			*pToken = (*pToken)->next;
+			pNode = CreateNewNode(pCtx);
+			SetNode(&(*pNode), ND_BLOCK, NULL, NULL, 0);
+		}
+	}
+	else if (IsExpectedTokenForKey(*pToken, TK_RETURN))
+	{
+		*pToken = (*pToken)->next;
+
+		pNode = CreateNewNode(pCtx);
+		SetNode(&(*pNode), ND_RTN, Expr(pCtx, &(*pToken)), NULL, 0);
 	}
 	else if (IsExpectedToken("{", *pToken))
 	{
 		*pToken = (*pToken)->next;
-		pNode = CreateNewNode();
+		pNode = CreateNewNode(pCtx);
 		SetNode(&(*pNode), ND_BLOCK, NULL, NULL, 0);
 		struct Node* pHead = pNode;
 		while(!IsExpectedToken("}", *pToken))
 		{
-			pNode->pBlock = Stmt(&(*pToken), pSrc, pFirstLVar);
-			pNode = pNode->pBlock;
+			struct Node* const pStmt = Stmt(pCtx, &(*pToken));
+			if (pNode == pHead) { pHead->pBlock = pStmt; }
+			else                { pNode->pNext = pStmt; }
+			pNode = pStmt;
 		}
 		*pToken = (*pToken)->next;
 		return pHead;
 	}
 	else if (IsExpectedTokenForKey(*pToken, TK_WHILE))
 	{
+		pNode = CreateNewNode(pCtx);
+		SetNode(&(*pNode), ND_WHILE, NULL, NULL, 0);
+		pNode->srcPos = (int)((*pToken)->str - pCtx->pSrc);
 		*pToken = (*pToken)->next;
 
-		pNode = CreateNewNode();
-		SetNode(&(*pNode), ND_WHILE, NULL, NULL, 0);
+		if (!IsExpectedToken("(", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token '('."); }
+		*pToken = (*pToken)->next;
+		pNode->pCond = Expr(pCtx, &(*pToken));
+		if (!IsExpectedToken(")", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token ')'."); }
+		*pToken = (*pToken)->next;
+		++pCtx->breakableDepth;
+		pNode->pThen = Stmt(pCtx, &(*pToken));
+		--pCtx->breakableDepth;
+		return pNode;
+	}
+	else if (IsExpectedTokenForKey(*pToken, TK_SWITCH))
+	{
+		*pToken = (*pToken)->next;
 
-		if (!IsExpectedToken("(", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token '('."); }
+		pNode = CreateNewNode(pCtx);
+		SetNode(&(*pNode), ND_SWITCH, NULL, NULL, 0);
+
+		if (!IsExpectedToken("(", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token '('."); }
 		*pToken = (*pToken)->next;
-		pNode->pCond = Expr(&(*pToken), pSrc, pFirstLVar);
-		if (!IsExpectedToken(")", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token ')'."); }
+		pNode->pCond = Expr(pCtx, &(*pToken));
+		if (!IsExpectedToken(")", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token ')'."); }
 		*pToken = (*pToken)->next;
-		pNode->pThen = Stmt(&(*pToken), pSrc, pFirstLVar);
+
+		// 本体中のcase/defaultはこのswitchに登録される
+		struct Node* const pOuterSwitch = pCtx->pCurrentSwitch;
+		pCtx->pCurrentSwitch = pNode;
+		++pCtx->breakableDepth;
+		pNode->pThen = Stmt(pCtx, &(*pToken));
+		--pCtx->breakableDepth;
+		pCtx->pCurrentSwitch = pOuterSwitch;
 		return pNode;
 	}
-	else if (IsExpectedTokenForKey(*pToken, TK_IF))
+	else if (IsExpectedTokenForKey(*pToken, TK_CASE) || IsExpectedTokenForKey(*pToken, TK_DEFAULT))
 	{
+		const bool isDefault = IsExpectedTokenForKey(*pToken, TK_DEFAULT);
+		const char* const pLabelLoc = (*pToken)->str;
+		if (pCtx->pCurrentSwitch == NULL) { ErrorAt(pCtx, (*pToken)->str, "case/default outside of switch."); }
+		if (isDefault && pCtx->pCurrentSwitch->pDefault != NULL) { ErrorAt(pCtx, (*pToken)->str, "multiple default labels."); }
 		*pToken = (*pToken)->next;
 
-		pNode = CreateNewNode();
+		pNode = CreateNewNode(pCtx);
+		if (isDefault)
+		{
+			SetNode(&(*pNode), ND_DEFAULT, NULL, NULL, 0);
+			pCtx->pCurrentSwitch->pDefault = pNode;
+		}
+		else
+		{
+			// "-"? num
+			int sign = 1;
+			if (IsExpectedToken("-", *pToken)) { sign = -1; *pToken = (*pToken)->next; }
+			if (!IsExpectedNumber(*pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token num"); }
+			SetNode(&(*pNode), ND_CASE, NULL, NULL, sign * (*pToken)->value);
+			*pToken = (*pToken)->next;
+			for (const struct Node* pCase = pCtx->pCurrentSwitch->pCaseNext; pCase != NULL; pCase = pCase->pCaseNext)
+			{
+				if (pCase->value == pNode->value) { ErrorAt(pCtx, pLabelLoc, "duplicate case value %d.", pNode->value); }
+			}
+
+			// 並びはコード生成時に値でソートするので先頭に追加する
+			pNode->pCaseNext = pCtx->pCurrentSwitch->pCaseNext;
+			pCtx->pCurrentSwitch->pCaseNext = pNode;
+		}
+
+		if (!IsExpectedToken(":", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token ':'."); }
+		*pToken = (*pToken)->next;
+		pNode->pThen = Stmt(pCtx, &(*pToken));
+		return pNode;
+	}
+	else if (IsExpectedTokenForKey(*pToken, TK_BREAK))
+	{
+		if (pCtx->breakableDepth == 0) { ErrorAt(pCtx, (*pToken)->str, "break outside of loop or switch."); }
+		*pToken = (*pToken)->next;
+
+		pNode = CreateNewNode(pCtx);
+		SetNode(&(*pNode), ND_BREAK, NULL, NULL, 0);
+	}
+	else if (IsExpectedTokenForKey(*pToken, TK_IF))
+	{
+		pNode = CreateNewNode(pCtx);
 		SetNode(&(*pNode), ND_IF, NULL, NULL, 0);
+		pNode->srcPos = (int)((*pToken)->str - pCtx->pSrc);
+		*pToken = (*pToken)->next;
 
 		// "if" "(" expr ")"
-		if (!IsExpectedToken("(", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token '('."); }
+		if (!IsExpectedToken("(", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token '('."); }
 		*pToken = (*pToken)->next;
-		pNode->pCond = Expr(&(*pToken), pSrc, pFirstLVar);
-		if (!IsExpectedToken(")", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token ')'."); }
+		pNode->pCond = Expr(pCtx, &(*pToken));
+		if (!IsExpectedToken(")", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token ')'."); }
 		*pToken = (*pToken)->next;
 		// stmt
-		pNode->pThen = Stmt(&(*pToken), pSrc, pFirstLVar);
+		pNode->pThen = Stmt(pCtx, &(*pToken));
 		// ("else" stmt)?
 		if (IsExpectedTokenForKey(*pToken, TK_ELSE))
 		{
 			*pToken = (*pToken)->next;
-			pNode->pElse = Stmt(&(*pToken), pSrc, pFirstLVar);
+			pNode->pElse = Stmt(pCtx, &(*pToken));
 		}
 		return pNode;
 	}
 	else
 	{
-		pNode = Expr(&(*pToken), pSrc, pFirstLVar);
+		pNode = Expr(pCtx, &(*pToken));
 	}
 
-	if (!IsExpectedToken(";", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token ';'."); }
+	if (!IsExpectedToken(";", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token ';'."); }
 	*pToken = (*pToken)->next;
 
 	return pNode;
 }
-// expr = Assign
-struct Node* Expr(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+// -- EXPRESSION --
+// 二項演算子テーブル(優先順位が大きいほど強く結合)
+struct BinaryOperator
 {
-	return Assign(&(*pToken), pSrc, pFirstLVar);
-}
-// assign = equality ("=" assign)?
-struct Node* Assign(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+	enum NodeKind kind;
+	int precedence;
+	bool isRightAssoc; // "=" は右結合
+	bool isSwap;       // ">" ">=" は左右を入れ替えて "<" "<=" として扱う
+};
+enum
 {
-	struct Node* pNode = Equality(&(*pToken), pSrc, pFirstLVar);
-	if (IsExpectedToken("=", *pToken))
-	{
-		*pToken = (*pToken)->next;
-
-		struct Node* const pTmp = CreateNewNode();
-		SetNode(&(*pTmp), ND_ASSIGN, pNode, Assign(&(*pToken), pSrc, pFirstLVar), 0);
-		pNode = pTmp;
-	}
-	return pNode;
-}
-// equality = relational ("==" relational | "!=" relational)*
-struct Node* Equality(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+	BOP_ASSIGN,
+	BOP_EQU, BOP_NEQ,
+	BOP_LTH, BOP_LEQ, BOP_GTH, BOP_GEQ,
+	BOP_ADD, BOP_SUB,
+	BOP_MUL, BOP_DIV,
+	BOP_NONE,
+};
+static const struct BinaryOperator binaryOperators[] =
 {
-	struct Node* pNode = Relational(&(*pToken), pSrc, pFirstLVar);
-	while(true)
+	{ND_ASSIGN, 1, true,  false}, // =
+	{ND_EQU,    2, false, false}, // ==
+	{ND_NEQ,    2, false, false}, // !=
+	{ND_LTH,    3, false, false}, // <
+	{ND_LEQ,    3, false, false}, // <=
+	{ND_LTH,    3, false, true},  // >
+	{ND_LEQ,    3, false, true},  // >=
+	{ND_ADD,    4, false, false}, // +
+	{ND_SUB,    4, false, false}, // -
+	{ND_MUL,    5, false, false}, // *
+	{ND_DIV,    5, false, false}, // /
+};
+// 演算子スタック上の特殊要素
+enum
+{
+	SOP_PAREN = BOP_NONE + 1, // "("
+	SOP_PLUS,                 // 単項 "+"
+	SOP_MINUS,                // 単項 "-"
+};
+// トークンを二項演算子に分類(線形探索せず先頭文字で決める)
+static int FindBinaryOperator(const struct Token* const pToken)
+{
+	if (pToken->kind != TK_RESERVED) { return BOP_NONE; }
+	const char ch = pToken->str[0];
+	if (pToken->len == 2)
 	{
-		if (IsExpectedToken("==", *pToken))
+		if (pToken->str[1] != '=') { return BOP_NONE; }
+		switch(ch)
 		{
-			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_EQU, pNode, Relational(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
+			case '=': return BOP_EQU;
+			case '!': return BOP_NEQ;
+			case '<': return BOP_LEQ;
+			case '>': return BOP_GEQ;
 		}
-		else if (IsExpectedToken("!=", *pToken))
-		{
-			*pToken = (*pToken)->next;
+		return BOP_NONE;
+	}
+	switch(ch)
+	{
+		case '=': return BOP_ASSIGN;
+		case '<': return BOP_LTH;
+		case '>': return BOP_GTH;
+		case '+': return BOP_ADD;
+		case '-': return BOP_SUB;
+		case '*': return BOP_MUL;
+		case '/': return BOP_DIV;
+	}
+	return BOP_NONE;
+}
 
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_NEQ, pNode, Relational(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
-		}
-		else { break; }
+// 式解析用の明示的なスタック(深い入れ子でもCのスタックを消費しない)
+// 領域はコンテキストが持ち，式をまたいで使い回す
+struct ExprStack
+{
+	struct MccContext* pCtx;
+	struct Node** pOperands;
+	int operandSize;
+	int* pOperators;
+	int operatorSize;
+	int parenDepth;
+};
+static void InitExprStack(struct MccContext* const pCtx, struct ExprStack* const pStack)
+{
+	pStack->pCtx = pCtx;
+	pStack->pOperands = (struct Node**)ReserveBuffer(&pCtx->exprOperands, 32, sizeof(struct Node*));
+	pStack->operandSize = 0;
+	pStack->pOperators = (int*)ReserveBuffer(&pCtx->exprOperators, 32, sizeof(int));
+	pStack->operatorSize = 0;
+	pStack->parenDepth = 0;
+}
+static void PushOperand(struct ExprStack* const pStack, struct Node* const pNode)
+{
+	pStack->pOperands = (struct Node**)ReserveBuffer(&pStack->pCtx->exprOperands, pStack->operandSize + 1, sizeof(struct Node*));
+	pStack->pOperands[pStack->operandSize++] = pNode;
+}
+static void PushOperator(struct ExprStack* const pStack, const int op)
+{
+	pStack->pOperators = (int*)ReserveBuffer(&pStack->pCtx->exprOperators, pStack->operatorSize + 1, sizeof(int));
+	pStack->pOperators[pStack->operatorSize++] = op;
+}
+// 演算子スタックの先頭を1つ取り出してノードを組み立てる
+static void ReduceOperator(struct ExprStack* const pStack)
+{
+	assert(pStack->operatorSize > 0 && pStack->operandSize > 0);
+	const int op = pStack->pOperators[--pStack->operatorSize];
+	struct Node* const pRhs = pStack->pOperands[--pStack->operandSize];
+	struct Node* const pNode = CreateNewNode(pStack->pCtx);
+
+	if (op == SOP_PLUS)
+	{
+		// 単項 "+" はオペランドを0に置き換える(従来の動作．auto_testの期待値)
+		SetNode(&(*pNode), ND_NUM, NULL, NULL, 0);
 	}
-	return pNode;
+	else if (op == SOP_MINUS)
+	{
+		// -x = 0 - x
+		struct Node* const pZero = CreateNewNode(pStack->pCtx);
+		SetNode(&(*pZero), ND_NUM, NULL, NULL, 0);
+		SetNode(&(*pNode), ND_SUB, pZero, pRhs, 0);
+	}
+	else
+	{
+		assert(op < BOP_NONE && pStack->operandSize > 0);
+		struct Node* const pLhs = pStack->pOperands[--pStack->operandSize];
+		const struct BinaryOperator* const pOp = &binaryOperators[op];
+		if (pOp->isSwap) { SetNode(&(*pNode), pOp->kind, pRhs, pLhs, 0); }
+		else             { SetNode(&(*pNode), pOp->kind, pLhs, pRhs, 0); }
+	}
+	pStack->pOperands[pStack->operandSize++] = pNode;
 }
-// relational = add ("<" add | "<=" add | ">" add | ">=" add)*
-struct Node* Relational(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+// 新しい二項演算子を積む前に，先に結合すべき演算子を畳み込む
+static void ReduceForOperator(struct ExprStack* const pStack, const int op)
 {
-	struct Node* pNode = Add(&(*pToken), pSrc, pFirstLVar);
-	while(true)
+	const struct BinaryOperator* const pOp = &binaryOperators[op];
+	while(pStack->operatorSize > 0)
 	{
-		if (IsExpectedToken("<", *pToken))
+		const int top = pStack->pOperators[pStack->operatorSize - 1];
+		if (top == SOP_PAREN) { break; }
+		if (top < BOP_NONE)
 		{
-			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_LTH, pNode, Add(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
+			const int topPrecedence = binaryOperators[top].precedence;
+			if (topPrecedence < pOp->precedence) { break; }
+			if (topPrecedence == pOp->precedence && pOp->isRightAssoc) { break; }
 		}
-		else if (IsExpectedToken("<=", *pToken))
-		{
-			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_LEQ, pNode, Add(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
-		}
-		else if (IsExpectedToken(">", *pToken))
-		{
-			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_LTH, Relational(&(*pToken), pSrc, pFirstLVar), pNode, 0);
-			pNode = pTmp;
-		}
-		else if (IsExpectedToken(">=", *pToken))
-		{
-			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_LEQ, Relational(&(*pToken), pSrc, pFirstLVar), pNode, 0);
-			pNode = pTmp;
-		}
-		else { break; }
+		// 単項演算子は常に先に結合する
+		ReduceOperator(pStack);
 	}
-	return pNode;
 }
-// add = mul ("+" mul | "-" mul)*
-struct Node* Add(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+// expr = unary (binary-op unary)*
+//   binary-op: "=" < "==" "!=" < "<" "<=" ">" ">=" < "+" "-" < "*" "/" ("="のみ右結合)
+//   unary = ("+" | "-" | "(")* primary ")"*
+// 再帰下降ではなく演算子スタックによる優先順位法で解析する
+struct Node* Expr(struct MccContext* const pCtx, struct Token** pToken)
 {
-	struct Node* pNode = Mul(&(*pToken), pSrc, pFirstLVar);
+	struct ExprStack stack;
+	InitExprStack(pCtx, &stack);
+
 	while(true)
 	{
-		if (IsExpectedToken("+", *pToken))
+		// オペランド待ち: 前置の "(" "+" "-" を積んでから primary を読む
+		if (IsExpectedToken("(", *pToken))
 		{
+			PushOperator(&stack, SOP_PAREN);
+			++stack.parenDepth;
 			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_ADD, pNode, Mul(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
+			continue;
 		}
-		else if (IsExpectedToken("-", *pToken))
+		if (IsExpectedToken("+", *pToken) || IsExpectedToken("-", *pToken))
 		{
+			PushOperator(&stack, ((*pToken)->str[0] == '+') ? SOP_PLUS : SOP_MINUS);
 			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_SUB, pNode, Mul(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
+			continue;
 		}
-		else { break; }
-	}
-	return pNode;
-}
-// mul = unary ( "*" unary | "/" unary ) *
-struct Node* Mul(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
-{
-	struct Node* pNode = Unary(&(*pToken), pSrc, pFirstLVar);
-	while(true) // 0回以上の繰り返し
-	{
-		if (IsExpectedToken("*", *pToken))
-		{
-			*pToken = (*pToken)->next;
+		PushOperand(&stack, Primary(pCtx, &(*pToken)));
 
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_MUL, pNode, Unary(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
-		}
-		else if (IsExpectedToken("/", *pToken))
+		// 演算子待ち: 対応する ")" を閉じてから二項演算子を探す
+		while(stack.parenDepth > 0 && IsExpectedToken(")", *pToken))
 		{
+			while(stack.pOperators[stack.operatorSize - 1] != SOP_PAREN) { ReduceOperator(&stack); }
+			--stack.operatorSize;
+			--stack.parenDepth;
 			*pToken = (*pToken)->next;
-
-			struct Node* const pTmp = CreateNewNode();
-			SetNode(&(*pTmp), ND_DIV, pNode, Unary(&(*pToken), pSrc, pFirstLVar), 0);
-			pNode = pTmp;
 		}
-		else { break; }
-	}
-	return pNode;
-}
-// unary = ("+" | "-" )? primary
-struct Node* Unary(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
-{
-	if (IsExpectedToken("+", *pToken))
-	{
+		const int op = FindBinaryOperator(*pToken);
+		if (op == BOP_NONE) { break; }
+		ReduceForOperator(&stack, op);
+		PushOperator(&stack, op);
 		*pToken = (*pToken)->next;
-
-		struct Node* pNode = Primary(&(*pToken), pSrc, pFirstLVar);
-		SetNode(&(*pNode), ND_NUM, NULL, NULL, 0);
-		return pNode;
 	}
-	else if (IsExpectedToken("-", *pToken))
-	{
-		*pToken = (*pToken)->next;
-
-		struct Node* const pLhs = CreateNewNode();
-		SetNode(&(*pLhs), ND_NUM, NULL, NULL, 0);
 
-		struct Node* const pNode = CreateNewNode();
-		SetNode(&(*pNode), ND_SUB, pLhs, Primary(&(*pToken), pSrc, pFirstLVar), 0);
-		return pNode;
-	}
-	return Primary(&(*pToken), pSrc, pFirstLVar);
+	if (stack.parenDepth > 0) { ErrorAt(pCtx, (*pToken)->str, "need token ')'."); }
+	while(stack.operatorSize > 0) { ReduceOperator(&stack); }
+	assert(stack.operandSize == 1);
+	return stack.pOperands[0];
 }
-// primary = num | ident | ident ("(" ident? ")")? | "(" expr ")"
-struct Node* Primary(struct Token** pToken, const char* const pSrc, struct LocalVar* const pFirstLVar)
+// primary = num | ident | ident ("(" ident? ")")?
+struct Node* Primary(struct MccContext* const pCtx, struct Token** pToken)
 {
-	if (IsExpectedToken("(", *pToken))
-	{
-		*pToken = (*pToken)->next;
-
-		struct Node* const pNode = Expr(&(*pToken), pSrc, pFirstLVar);
-		if (!IsExpectedToken(")", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token ')'."); }
-		*pToken = (*pToken)->next;
-		return pNode;
-	}
-	else if (IsExpectedIdent(*pToken))
+	if (IsExpectedIdent(*pToken))
 	{
-		struct Node* const pNode = CreateNewNode();
+		struct Node* const pNode = CreateNewNode(pCtx);
 
 		// function
 		if (IsExpectedToken("(", (*pToken)->next))
@@ -580,61 +683,48 @@ struct Node* Primary(struct Token** pToken, const char* const pSrc, struct Local
 			// argument
 			if (IsExpectedIdent(*pToken))
 			{
-				exit(1); // そのうち作る
+				ErrorAt(pCtx, (*pToken)->str, "function arguments are not supported yet."); // そのうち作る
 			}
 
-			if (!IsExpectedToken(")", *pToken)) { ErrorAt((*pToken)->str, pSrc, "need token ')'."); }
+			if (!IsExpectedToken(")", *pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token ')'."); }
 			*pToken = (*pToken)->next;
 			return pNode;
 		}
 
+		// 宣言されていない変数は8Byteとして最初の参照で作る
 		SetNode(&(*pNode), ND_LVAR, NULL, NULL, 0);
-		const struct LocalVar* pLVar = FindLocalVar(pFirstLVar, *pToken);
-		if (pLVar == NULL)
-		{
-			struct LocalVar* const pTmp = (struct LocalVar*)malloc(1 * sizeof(struct LocalVar));
-			++lvarMemoryCount;
-			struct LocalVar* pLastLVar = GetLastLocalVar(pFirstLVar);
-			pTmp->next = NULL;
-			pTmp->name = (*pToken)->str;
-			pTmp->len = (*pToken)->len;
-			pTmp->offset = pLastLVar->offset + 8/*Bytes*/;
-
-			pLastLVar->next = pTmp;
-			pNode->offset = pTmp->offset;
-		}
-		else
-		{
-			pNode->offset = pLVar->offset;
-		}
+		struct LocalVar* pLVar = (struct LocalVar*)FindLocalVar(&pCtx->firstLVar, *pToken);
+		if (pLVar == NULL) { pLVar = CreateLocalVar(pCtx, (*pToken)->str, (*pToken)->len, 8/*Bytes*/); }
+		pNode->pLVar = pLVar;
 		*pToken = (*pToken)->next;
 		return pNode;
 	}
 
-	if (!IsExpectedNumber(*pToken)) { ErrorAt((*pToken)->str, pSrc, "need token num"); }
-	struct Node* const pNode = CreateNewNode();
+	if (!IsExpectedNumber(*pToken)) { ErrorAt(pCtx, (*pToken)->str, "need token num"); }
+	struct Node* const pNode = CreateNewNode(pCtx);
 	SetNode(&(*pNode), ND_NUM, NULL, NULL, (*pToken)->value);
 	*pToken = (*pToken)->next;
 	return pNode;
 }
-int ReleaseNodeMemory(struct Node* pRootNode)
+// -- LOCAL VARIABLE --
+// 変数を末尾に追加する．オフセットはAllocateLocalVarsで決める
+// 名前の長さが0の変数はコンパイラが作る一時変数(名前では見つからない)
+struct LocalVar* CreateLocalVar(struct MccContext* const pCtx, const char* const pName, const int len, const int size)
 {
-	if (pRootNode == NULL) { return nodeMemoryCount; }
-
-	ReleaseNodeMemory(pRootNode->pBlock);
-	ReleaseNodeMemory(pRootNode->pCond);
-	ReleaseNodeMemory(pRootNode->pThen);
-	ReleaseNodeMemory(pRootNode->pElse);
-
-	ReleaseNodeMemory(pRootNode->pLhs);
-	ReleaseNodeMemory(pRootNode->pRhs);
-
-	free(pRootNode);
-	--nodeMemoryCount;
-	return nodeMemoryCount;
+	struct LocalVar* const pLVar = (struct LocalVar*)ArenaAlloc(pCtx, sizeof(struct LocalVar));
+	struct LocalVar* const pLastLVar = GetLastLocalVar(&pCtx->firstLVar);
+	pLVar->next = NULL;
+	pLVar->name = pName;
+	pLVar->len = len;
+	pLVar->size = size;
+	pLVar->offset = 0;
+	pLVar->index = pCtx->lvarMemoryCount++;
+	pLVar->begin = -1;
+	pLVar->end = -1;
+
+	pLastLVar->next = pLVar;
+	return pLVar;
 }
-
-// -- LOCAL VARIABLE --
 const struct LocalVar* FindLocalVar(const struct LocalVar* const pFirstLVar, const struct Token* const pToken)
 {
 	for (const struct LocalVar* pLVar = pFirstLVar; pLVar != NULL; pLVar = pLVar->next)
@@ -656,15 +746,3 @@ struct LocalVar* GetLastLocalVar(struct LocalVar* const pFirstLVar)
 	assert(pIndex != NULL);
 	return pIndex;
 }
-int ReleaseLocalVarMemory(struct LocalVar* pLVar)
-{
-	struct LocalVar* pDummy = pLVar;
-	while(pDummy != NULL)
-	{
-		pDummy = pLVar->next;
-		free(pLVar);
-		pLVar = pDummy;
-		--lvarMemoryCount;
-	}
-	return lvarMemoryCount;
-}
@@ -0,0 +1,169 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// ファイルには地点(if/while)ごとに "位置 実行回数 分岐回数" を1行ずつ書く
+
+// -- GENERATE --
+// 地点のカウンタ番号を返す．同じ位置は同じカウンタを共有する
+int GetProfileCounterIndex(struct MccContext* const pCtx, const int srcPos)
+{
+	assert(srcPos >= 0);
+	int* pCounterSites = (int*)pCtx->counterSites.pData;
+	for (int i = 0; i < pCtx->counterSiteSize; ++i)
+	{
+		if (pCounterSites[i] == srcPos) { return i * 2; }
+	}
+	pCounterSites = (int*)ReserveBuffer(&pCtx->counterSites, pCtx->counterSiteSize + 1, sizeof(int));
+	pCounterSites[pCtx->counterSiteSize] = srcPos;
+	return (pCtx->counterSiteSize++) * 2;
+}
+// mainのプロローグ直後: 終了時にカウンタを書き出すよう登録する
+void GenProfileRegister(struct MccContext* const pCtx)
+{
+	Emit(pCtx, "  lea rdi, [rip + .Lprofdump]\n");
+	Emit(pCtx, "  call atexit\n");
+}
+// アセンブラの文字列として書く(ダブルクォート，バックスラッシュ，制御文字はエスケープする)
+static void EmitString(struct MccContext* const pCtx, const char* const pStr)
+{
+	Emit(pCtx, "  .string \"");
+	for (const unsigned char* p = (const unsigned char*)pStr; *p != '\0'; ++p)
+	{
+		if (*p == '"' || *p == '\\') { Emit(pCtx, "\\%c", *p); }
+		else if (*p < 0x20 || *p == 0x7F) { Emit(pCtx, "\\%03o", *p); }
+		else { Emit(pCtx, "%c", *p); }
+	}
+	Emit(pCtx, "\"\n");
+}
+// カウンタ領域と書き出し関数
+void GenProfileRuntime(struct MccContext* const pCtx)
+{
+	const int counterSiteSize = pCtx->counterSiteSize;
+	const int* const pCounterSites = (const int*)pCtx->counterSites.pData;
+	const int counterSize = (counterSiteSize > 0) ? counterSiteSize * 2 : 1;
+
+	Emit(pCtx, "  .bss\n");
+	Emit(pCtx, "  .p2align 3\n");
+	Emit(pCtx, ".Lprofcnt:\n");
+	Emit(pCtx, "  .zero %d\n", counterSize * 8);
+
+	Emit(pCtx, "  .section .rodata\n");
+	Emit(pCtx, ".Lprofpath:\n");
+	EmitString(pCtx, pCtx->option.pProfilePath);
+	Emit(pCtx, ".Lprofmode:\n");
+	Emit(pCtx, "  .string \"w\"\n");
+	Emit(pCtx, ".Lproffmt:\n");
+	Emit(pCtx, "  .string \"%%d %%ld %%ld\\n\"\n");
+	Emit(pCtx, "  .p2align 2\n");
+	Emit(pCtx, ".Lprofpos:\n");
+	for (int i = 0; i < counterSiteSize; ++i) { Emit(pCtx, "  .long %d\n", pCounterSites[i]); }
+	Emit(pCtx, "  .long 0\n");
+
+	// rbx: FILE*, r12: 地点番号 (3回のpushで16Byte境界に揃う)
+	Emit(pCtx, "  .text\n");
+	Emit(pCtx, ".Lprofdump:\n");
+	Emit(pCtx, "  push rbx\n");
+	Emit(pCtx, "  push r12\n");
+	Emit(pCtx, "  push r13\n");
+	Emit(pCtx, "  lea rdi, [rip + .Lprofpath]\n");
+	Emit(pCtx, "  lea rsi, [rip + .Lprofmode]\n");
+	Emit(pCtx, "  call fopen\n");
+	Emit(pCtx, "  test rax, rax\n");
+	Emit(pCtx, "  je .Lprofdone\n");
+	Emit(pCtx, "  mov rbx, rax\n");
+	Emit(pCtx, "  xor r12, r12\n");
+	Emit(pCtx, ".Lprofloop:\n");
+	Emit(pCtx, "  cmp r12, %d\n", counterSiteSize);
+	Emit(pCtx, "  jge .Lprofclose\n");
+	Emit(pCtx, "  lea rax, [rip + .Lprofpos]\n");
+	Emit(pCtx, "  mov edx, dword ptr [rax + r12 * 4]\n");
+	Emit(pCtx, "  lea rax, [rip + .Lprofcnt]\n");
+	Emit(pCtx, "  mov r13, r12\n");
+	Emit(pCtx, "  shl r13, 4\n");
+	Emit(pCtx, "  mov rcx, [rax + r13]\n");
+	Emit(pCtx, "  mov r8, [rax + r13 + 8]\n");
+	Emit(pCtx, "  mov rdi, rbx\n");
+	Emit(pCtx, "  lea rsi, [rip + .Lproffmt]\n");
+	Emit(pCtx, "  mov eax, 0\n");
+	Emit(pCtx, "  call fprintf\n");
+	Emit(pCtx, "  inc r12\n");
+	Emit(pCtx, "  jmp .Lprofloop\n");
+	Emit(pCtx, ".Lprofclose:\n");
+	Emit(pCtx, "  mov rdi, rbx\n");
+	Emit(pCtx, "  call fclose\n");
+	Emit(pCtx, ".Lprofdone:\n");
+	Emit(pCtx, "  pop r13\n");
+	Emit(pCtx, "  pop r12\n");
+	Emit(pCtx, "  pop rbx\n");
+	Emit(pCtx, "  ret\n");
+}
+
+// -- USE --
+static int CompareProfileSite(const void* pA, const void* pB)
+{
+	const struct ProfileSite* const pSiteA = (const struct ProfileSite*)pA;
+	const struct ProfileSite* const pSiteB = (const struct ProfileSite*)pB;
+	return (pSiteA->srcPos > pSiteB->srcPos) - (pSiteA->srcPos < pSiteB->srcPos);
+}
+bool LoadProfile(struct MccContext* const pCtx, const char* const pPath)
+{
+	FILE* const pFile = fopen(pPath, "r");
+	if (pFile == NULL) { return false; }
+
+	pCtx->profileSiteSize = 0;
+	struct ProfileSite site;
+	while(fscanf(pFile, "%d %lld %lld", &site.srcPos, &site.entry, &site.taken) == 3)
+	{
+		struct ProfileSite* const pProfileSites = (struct ProfileSite*)ReserveBuffer(&pCtx->profileSites, pCtx->profileSiteSize + 1, sizeof(struct ProfileSite));
+		pProfileSites[pCtx->profileSiteSize++] = site;
+	}
+	fclose(pFile);
+
+	qsort(pCtx->profileSites.pData, pCtx->profileSiteSize, sizeof(struct ProfileSite), CompareProfileSite);
+	return true;
+}
+// if/whileノードに実行回数を付ける
+void AttachProfile(struct MccContext* const pCtx, struct Node* const pNode)
+{
+	if (pNode == NULL) { return; }
+
+	if ((pNode->kind == ND_IF || pNode->kind == ND_WHILE) && pCtx->profileSiteSize > 0)
+	{
+		struct ProfileSite key;
+		key.srcPos = pNode->srcPos;
+		const struct ProfileSite* const pSite = bsearch(&key, pCtx->profileSites.pData, pCtx->profileSiteSize, sizeof(struct ProfileSite), CompareProfileSite);
+		if (pSite != NULL)
+		{
+			pNode->hasProfile = 1;
+			pNode->profEntry = pSite->entry;
+			pNode->profTaken = pSite->taken;
+		}
+	}
+
+	// 文だけをたどる(式にはif/whileは現れない)
+	switch(pNode->kind)
+	{
+		case ND_BLOCK:
+			for (struct Node* pTmp = pNode->pBlock; pTmp != NULL; pTmp = pTmp->pNext) { AttachProfile(pCtx, pTmp); }
+			break;
+		case ND_IF:
+		case ND_WHILE:
+		case ND_SWITCH:
+		case ND_CASE:
+		case ND_DEFAULT:
+			AttachProfile(pCtx, pNode->pThen);
+			AttachProfile(pCtx, pNode->pElse);
+			break;
+		default:
+			break;
+	}
+}
@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mcc.h"
+
+// サーバとクライアントで共通の通信処理
+
+// 環境変数がなければユーザごとの既定の位置
+void GetSocketPath(char* const pPath, const size_t size)
+{
+	const char* const pEnv = getenv(MCC_SOCKET_ENV);
+	if (pEnv != NULL && pEnv[0] != '\0') { snprintf(pPath, size, "%s", pEnv); }
+	else { snprintf(pPath, size, "/tmp/mcc-%u.sock", (unsigned int)getuid()); }
+}
+// 接続したソケットを返す(失敗は-1)
+int ConnectServer(const char* const pPath)
+{
+	struct sockaddr_un addr;
+	if (strlen(pPath) >= sizeof(addr.sun_path)) { errno = ENAMETOOLONG; return -1; }
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, pPath);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) { return -1; }
+	if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		const int error = errno;
+		close(fd);
+		errno = error;
+		return -1;
+	}
+	return fd;
+}
+
+// -- FRAME --
+bool ReadFull(const int fd, void* const pData, const size_t size)
+{
+	size_t done = 0;
+	while(done < size)
+	{
+		const ssize_t len = read(fd, (char*)pData + done, size - done);
+		if (len < 0 && errno == EINTR) { continue; }
+		if (len <= 0) { return false; }
+		done += (size_t)len;
+	}
+	return true;
+}
+bool WriteFull(const int fd, const void* const pData, const size_t size)
+{
+	size_t done = 0;
+	while(done < size)
+	{
+		const ssize_t len = write(fd, (const char*)pData + done, size - done);
+		if (len < 0 && errno == EINTR) { continue; }
+		if (len <= 0) { return false; }
+		done += (size_t)len;
+	}
+	return true;
+}
+static bool WriteU32(const int fd, const uint32_t value)
+{
+	return WriteFull(fd, &value, sizeof(value));
+}
+static bool ReadU32(const int fd, uint32_t* const pValue)
+{
+	return ReadFull(fd, pValue, sizeof(*pValue));
+}
+bool WriteString(const int fd, const char* const pData, const size_t size)
+{
+	if (size > MCC_MESSAGE_MAX) { return false; }
+	return WriteU32(fd, (uint32_t)size) && WriteFull(fd, pData, size);
+}
+// 長さ付き文字列をpOutに読む(NUL終端する)
+bool ReadString(const int fd, struct OutBuffer* const pOut)
+{
+	uint32_t size = 0;
+	if (!ReadU32(fd, &size) || size > MCC_MESSAGE_MAX) { return false; }
+	if (pOut->capacity < (size_t)size + 1)
+	{
+		char* const pData = (char*)realloc(pOut->pData, (size_t)size + 1);
+		if (pData == NULL) { return false; }
+		pOut->pData = pData;
+		pOut->capacity = (size_t)size + 1;
+	}
+	if (!ReadFull(fd, pOut->pData, size)) { return false; }
+	pOut->pData[size] = '\0';
+	pOut->size = size;
+	return true;
+}
+
+// -- SERVER --
+bool SendResponse(const int fd, const int status, const char* const pStdout, const size_t stdoutSize, const char* const pStderr, const size_t stderrSize)
+{
+	return WriteU32(fd, (uint32_t)status) && WriteString(fd, pStdout, stdoutSize) && WriteString(fd, pStderr, stderrSize);
+}
+
+// -- CLIENT --
+bool SendRequest(const int fd, const char* const pWorkDir, const int argc, char* const argv[])
+{
+	if (!WriteString(fd, pWorkDir, strlen(pWorkDir))) { return false; }
+	if (!WriteU32(fd, (uint32_t)argc)) { return false; }
+	for (int i = 0; i < argc; ++i)
+	{
+		if (!WriteString(fd, argv[i], strlen(argv[i]))) { return false; }
+	}
+	return true;
+}
+bool ReceiveResponse(const int fd, int* const pStatus, struct OutBuffer* const pStdout, struct OutBuffer* const pStderr)
+{
+	uint32_t status = 0;
+	if (!ReadU32(fd, &status)) { return false; }
+	*pStatus = (int)status;
+	return ReadString(fd, pStdout) && ReadString(fd, pStderr);
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// トークナイザの走査: 空白/識別子/数字の連続を16-32Byteずつ調べて長さを返す
+// 入力はNULの後ろにSCAN_PADDINGバイト読めること(NULはどの種類にも含まれないのでそこで止まる)
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_HAS_SIMD 1
+#include <immintrin.h>
+#else
+#define SCAN_HAS_SIMD 0
+#endif
+
+// -- SCALAR --
+static bool IsScanSpace(const char ch)
+{
+	return (ch == ' ') || ('\t' <= ch && ch <= '\r');
+}
+static size_t SkipSpacesScalar(const char* const pStr)
+{
+	size_t i = 0;
+	while(IsScanSpace(pStr[i])) { ++i; }
+	return i;
+}
+static size_t ScanLowerScalar(const char* const pStr)
+{
+	size_t i = 0;
+	while('a' <= pStr[i] && pStr[i] <= 'z') { ++i; }
+	return i;
+}
+static size_t ScanDigitsScalar(const char* const pStr)
+{
+	size_t i = 0;
+	while('0' <= pStr[i] && pStr[i] <= '9') { ++i; }
+	return i;
+}
+
+#if SCAN_HAS_SIMD
+// -- SSE2 --
+// 範囲判定は (x - low) <= (high - low) を符号なしで行う(min(d, n) == d)
+static unsigned int InRangeMaskSse2(const __m128i x, const char low, const char high)
+{
+	const __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(low));
+	return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(high - low))), d));
+}
+static size_t SkipSpacesSse2(const char* const pStr)
+{
+	for (size_t i = 0; ; i += 16)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i*)&pStr[i]);
+		const unsigned int space = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+		const unsigned int mismatch = ~(space | InRangeMaskSse2(x, '\t', '\r')) & 0xFFFF;
+		if (mismatch != 0) { return i + (size_t)__builtin_ctz(mismatch); }
+	}
+}
+static size_t ScanLowerSse2(const char* const pStr)
+{
+	for (size_t i = 0; ; i += 16)
+	{
+		const unsigned int mismatch = ~InRangeMaskSse2(_mm_loadu_si128((const __m128i*)&pStr[i]), 'a', 'z') & 0xFFFF;
+		if (mismatch != 0) { return i + (size_t)__builtin_ctz(mismatch); }
+	}
+}
+static size_t ScanDigitsSse2(const char* const pStr)
+{
+	for (size_t i = 0; ; i += 16)
+	{
+		const unsigned int mismatch = ~InRangeMaskSse2(_mm_loadu_si128((const __m128i*)&pStr[i]), '0', '9') & 0xFFFF;
+		if (mismatch != 0) { return i + (size_t)__builtin_ctz(mismatch); }
+	}
+}
+
+// -- AVX2 --
+// -mavx2なしでビルドできるよう関数単位で有効にする．呼ぶのはCPUが対応しているときだけ
+#define TARGET_AVX2 __attribute__((target("avx2")))
+TARGET_AVX2 static unsigned int InRangeMaskAvx2(const __m256i x, const char low, const char high)
+{
+	const __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(low));
+	return (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)(high - low))), d));
+}
+TARGET_AVX2 static size_t SkipSpacesAvx2(const char* const pStr)
+{
+	for (size_t i = 0; ; i += 32)
+	{
+		const __m256i x = _mm256_loadu_si256((const __m256i*)&pStr[i]);
+		const unsigned int space = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+		const unsigned int mismatch = ~(space | InRangeMaskAvx2(x, '\t', '\r'));
+		if (mismatch != 0) { return i + (size_t)__builtin_ctz(mismatch); }
+	}
+}
+TARGET_AVX2 static size_t ScanLowerAvx2(const char* const pStr)
+{
+	for (size_t i = 0; ; i += 32)
+	{
+		const unsigned int mismatch = ~InRangeMaskAvx2(_mm256_loadu_si256((const __m256i*)&pStr[i]), 'a', 'z');
+		if (mismatch != 0) { return i + (size_t)__builtin_ctz(mismatch); }
+	}
+}
+TARGET_AVX2 static size_t ScanDigitsAvx2(const char* const pStr)
+{
+	for (size_t i = 0; ; i += 32)
+	{
+		const unsigned int mismatch = ~InRangeMaskAvx2(_mm256_loadu_si256((const __m256i*)&pStr[i]), '0', '9');
+		if (mismatch != 0) { return i + (size_t)__builtin_ctz(mismatch); }
+	}
+}
+#endif
+
+static const struct Scanner scanners[] =
+{
+	{"scalar", SkipSpacesScalar, ScanLowerScalar, ScanDigitsScalar},
+#if SCAN_HAS_SIMD
+	{"sse2", SkipSpacesSse2, ScanLowerSse2, ScanDigitsSse2},
+	{"avx2", SkipSpacesAvx2, ScanLowerAvx2, ScanDigitsAvx2},
+#endif
+};
+
+// このCPUで使える最も速い走査
+enum ScanLevel GetBestScanLevel(void)
+{
+#if SCAN_HAS_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) { return SCAN_AVX2; }
+	return SCAN_SSE2; // x86-64では必ず使える
+#else
+	return SCAN_SCALAR;
+#endif
+}
+// CPUの判定は呼び出し側で済ませておく(このCPUで使える水準だけを渡す)
+const struct Scanner* GetScanner(const enum ScanLevel level)
+{
+	assert(level >= SCAN_SCALAR && (size_t)level < sizeof(scanners) / sizeof(scanners[0]));
+	return &scanners[level];
+}
+
+// -- NUMBER --
+// 8桁の数字(先頭がpStr[0])を1度に変換する(SWAR)
+// 桁の少ない数は上位に寄せて下位を0で埋める
+static uint64_t ParseEightDigits(const char* const pStr, const size_t len)
+{
+	uint64_t chunk = 0;
+	memcpy(&chunk, pStr, sizeof(chunk));
+	chunk -= 0x3030303030303030ULL;
+	if (len < 8) { chunk <<= 8 * (8 - len); }
+	// 隣り合う2桁を2桁の数に，それを4桁の組2つにまとめて8桁にする
+	chunk = (chunk * 10) + (chunk >> 8);
+	chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) + (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	return (uint32_t)chunk;
+}
+// lenバイトの数字をstrtolと同じ値に変換する(pStrの後ろは8Byte読めること)
+int ParseDecimal(const char* const pStr, const size_t len)
+{
+	assert(len > 0);
+	// 18桁を超えるとlongに収まらないことがある．strtolの飽和に合わせる
+	if (len > 18) { return (int)strtol(pStr, NULL, 10); }
+
+	const size_t head = (len % 8 != 0) ? len % 8 : 8;
+	uint64_t value = ParseEightDigits(pStr, head);
+	for (size_t i = head; i < len; i += 8)
+	{
+		value = value * 100000000ULL + ParseEightDigits(&pStr[i], 8);
+	}
+	return (int)(long)value;
+}
@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mcc.h"
+
+// コンパイルサーバ: 接続ごとにスレッドを立て，要求ごとにRunCommandを実行する
+// コンテキストは使い終わったら貯めておき，次の接続で確保済みのアリーナごと使い回す
+
+#define SERVER_BACKLOG 64
+#define SERVER_ARGC_MAX 4096
+
+struct Server
+{
+	pthread_mutex_t mutex;
+	struct Buffer idleContexts; // struct MccContext*
+	int idleSize;
+};
+struct Connection
+{
+	struct Server* pServer;
+	int fd;
+};
+
+static struct MccContext* AcquireContext(struct Server* const pServer)
+{
+	struct MccContext* pCtx = NULL;
+	pthread_mutex_lock(&pServer->mutex);
+	if (pServer->idleSize > 0) { pCtx = ((struct MccContext**)pServer->idleContexts.pData)[--pServer->idleSize]; }
+	pthread_mutex_unlock(&pServer->mutex);
+	return (pCtx != NULL) ? pCtx : mcc_create_context();
+}
+static void ReleaseContext(struct Server* const pServer, struct MccContext* const pCtx)
+{
+	pthread_mutex_lock(&pServer->mutex);
+	struct MccContext** const pContexts = (struct MccContext**)ReserveBuffer(&pServer->idleContexts, pServer->idleSize + 1, sizeof(struct MccContext*));
+	pContexts[pServer->idleSize++] = pCtx;
+	pthread_mutex_unlock(&pServer->mutex);
+}
+
+// 1要求を読んで実行し応答を返す．接続が閉じられたらfalse
+static bool ServeRequest(struct MccContext* const pCtx, const int fd, struct OutBuffer* const pWorkDir, struct Buffer* const pArgs, struct Buffer* const pArgv)
+{
+	uint32_t argc = 0;
+	if (!ReadString(fd, pWorkDir) || !ReadFull(fd, &argc, sizeof(argc)) || argc > SERVER_ARGC_MAX) { return false; }
+
+	// 引数の領域は接続の間使い回す
+	const int oldCapacity = pArgs->capacity;
+	struct OutBuffer* const pArgBuffers = (struct OutBuffer*)ReserveBuffer(pArgs, (int)argc + 1, sizeof(struct OutBuffer));
+	for (int i = oldCapacity; i < pArgs->capacity; ++i) { mcc_init_out_buffer(&pArgBuffers[i]); }
+	char** const argv = (char**)ReserveBuffer(pArgv, (int)argc + 1, sizeof(char*));
+	for (uint32_t i = 0; i < argc; ++i)
+	{
+		if (!ReadString(fd, &pArgBuffers[i])) { return false; }
+		argv[i] = pArgBuffers[i].pData;
+	}
+	argv[argc] = NULL;
+
+	char* pOutData = NULL;
+	size_t outSize = 0;
+	char* pErrData = NULL;
+	size_t errSize = 0;
+	FILE* const pOut = open_memstream(&pOutData, &outSize);
+	FILE* const pErr = open_memstream(&pErrData, &errSize);
+	int status = 1;
+	if (pOut != NULL && pErr != NULL) { status = RunCommand(pCtx, pWorkDir->pData, (int)argc, argv, pOut, pErr); }
+	else { status = 70; }
+	if (pOut != NULL) { fclose(pOut); }
+	if (pErr != NULL) { fclose(pErr); }
+
+	const bool isSent = SendResponse(fd, status, (pOutData != NULL) ? pOutData : "", outSize, (pErrData != NULL) ? pErrData : "", errSize);
+	free(pOutData);
+	free(pErrData);
+	return isSent;
+}
+static void* ServeConnection(void* pArg)
+{
+	struct Connection* const pConnection = (struct Connection*)pArg;
+	struct MccContext* const pCtx = AcquireContext(pConnection->pServer);
+
+	struct OutBuffer workDir;
+	mcc_init_out_buffer(&workDir);
+	struct Buffer args = {NULL, 0};
+	struct Buffer argv = {NULL, 0};
+	while(pCtx != NULL && ServeRequest(pCtx, pConnection->fd, &workDir, &args, &argv)) {}
+
+	for (int i = 0; i < args.capacity; ++i) { mcc_release_out_buffer(&((struct OutBuffer*)args.pData)[i]); }
+	ReleaseBuffer(&args);
+	ReleaseBuffer(&argv);
+	mcc_release_out_buffer(&workDir);
+	if (pCtx != NULL) { ReleaseContext(pConnection->pServer, pCtx); }
+	close(pConnection->fd);
+	free(pConnection);
+	return NULL;
+}
+
+int RunServer(const char* const pPath)
+{
+	struct sockaddr_un addr;
+	if (strlen(pPath) >= sizeof(addr.sun_path)) { fprintf(stderr, "Socket path is too long: %s\n", pPath); return 1; }
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, pPath);
+
+	// 切れたクライアントへの書き込みで終了しないようにする
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, NULL);
+
+	const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0) { perror("socket"); return 1; }
+	unlink(pPath);
+	if (bind(listenFd, (const struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, SERVER_BACKLOG) != 0)
+	{
+		perror(pPath);
+		close(listenFd);
+		return 1;
+	}
+	fprintf(stderr, "mcc: listening on %s\n", pPath);
+
+	struct Server server;
+	pthread_mutex_init(&server.mutex, NULL);
+	server.idleContexts.pData = NULL;
+	server.idleContexts.capacity = 0;
+	server.idleSize = 0;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while(true)
+	{
+		const int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED) { continue; }
+			perror("accept");
+			break;
+		}
+		struct Connection* const pConnection = (struct Connection*)malloc(sizeof(struct Connection));
+		pthread_t thread;
+		if (pConnection == NULL) { close(fd); continue; }
+		pConnection->pServer = &server;
+		pConnection->fd = fd;
+		if (pthread_create(&thread, &attr, ServeConnection, pConnection) != 0)
+		{
+			close(fd);
+			free(pConnection);
+		}
+	}
+	pthread_attr_destroy(&attr);
+	close(listenFd);
+	unlink(pPath);
+	return 1;
+}
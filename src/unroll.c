@@ -0,0 +1,333 @@
+#include <ctype.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <string.h>
+#include <assert.h>
+
+#include "mcc.h"
+
+// 回数の決まったループの展開
+// 対象: while (i < N) { ...; i = i + c; } (i > N で減らす形, <=/>= も)
+//   iは本体の最後の文でだけ定数を足し，Nは本体で変わらない(関数呼び出し/代入を含まない)
+// 1. 直前の一続きの文でiに定数を代入していて，Nも定数なら回数が分かる．少なければ本体を回数分並べる
+// 2. それ以外は本体をF個並べたループと，残りを1周ずつ回す元のループに分ける
+//    while ((i < N) * ((F-1)*c < N - i)) { B; B; B; B; } while (i < N) B;
+//    並べた各本体の入口でも i < N が成り立つので，元のループと同じ回数だけ実行される
+// 一番内側のループだけを展開する
+// 本体の途中でこのループを抜けるbreakがあると残りのループへ落ちてしまうので展開しない
+// switchはcaseの登録先を複製し直す必要があるので展開しない
+
+#define UNROLL_BODY_MAX 64       // 展開する本体のノード数の上限
+#define UNROLL_FULL_TRIP_MAX 16  // 完全に展開する反復回数の上限
+#define UNROLL_FULL_NODE_MAX 512 // 完全に展開した後のノード数の上限
+
+struct CountedLoop
+{
+	struct LocalVar* pVar; // 誘導変数
+	struct Node* pBound;   // 条件の反対側の式
+	bool isIncrement;      // i < N (増やす) か N < i (減らす) か
+	int step;              // 1周の増分
+};
+
+static struct Node* NewNode(struct MccContext* const pCtx, const enum NodeKind kind, struct Node* const pLhs, struct Node* const pRhs, const int value)
+{
+	struct Node* const pNode = CreateNewNode(pCtx);
+	SetNode(&(*pNode), kind, pLhs, pRhs, value);
+	return pNode;
+}
+// 部分木を複製する(本体はUNROLL_BODY_MAX以下なので再帰してよい)
+static struct Node* CopyTree(struct MccContext* const pCtx, const struct Node* const pNode)
+{
+	if (pNode == NULL) { return NULL; }
+	struct Node* const pCopy = CreateNewNode(pCtx);
+	*pCopy = *pNode;
+	pCopy->pLhs = CopyTree(pCtx, pNode->pLhs);
+	pCopy->pRhs = CopyTree(pCtx, pNode->pRhs);
+	pCopy->pCond = CopyTree(pCtx, pNode->pCond);
+	pCopy->pThen = CopyTree(pCtx, pNode->pThen);
+	pCopy->pElse = CopyTree(pCtx, pNode->pElse);
+	pCopy->pBlock = CopyTree(pCtx, pNode->pBlock);
+	pCopy->pNext = CopyTree(pCtx, pNode->pNext);
+	return pCopy;
+}
+
+// ノード数を数える．limitを超えたら打ち切る
+static int CountNodes(const struct Node* const pNode, const int limit)
+{
+	if (pNode == NULL) { return 0; }
+	int count = 1;
+	const struct Node* const children[] = {pNode->pLhs, pNode->pRhs, pNode->pCond, pNode->pThen, pNode->pElse, pNode->pBlock, pNode->pNext};
+	for (int i = 0; i < (int)(sizeof(children)/sizeof(children[0])) && count <= limit; ++i)
+	{
+		count += CountNodes(children[i], limit - count);
+	}
+	return count;
+}
+// pExcept以外にpLVarへの代入があるか
+static bool IsAssigned(const struct Node* const pNode, const struct LocalVar* const pLVar, const struct Node* const pExcept)
+{
+	if (pNode == NULL) { return false; }
+	if (pNode != pExcept && pNode->kind == ND_ASSIGN && pNode->pLhs->pLVar == pLVar) { return true; }
+	const struct Node* const children[] = {pNode->pLhs, pNode->pRhs, pNode->pCond, pNode->pThen, pNode->pElse, pNode->pBlock, pNode->pNext};
+	for (int i = 0; i < (int)(sizeof(children)/sizeof(children[0])); ++i)
+	{
+		if (IsAssigned(children[i], pLVar, pExcept)) { return true; }
+	}
+	return false;
+}
+// 展開しない文があるか: 内側のループ(外側の周回の手間は内側に比べて小さい)，switch，break
+static bool HasUncopyable(const struct Node* const pNode)
+{
+	if (pNode == NULL) { return false; }
+	switch(pNode->kind)
+	{
+		case ND_WHILE: case ND_SWITCH: case ND_CASE: case ND_DEFAULT: case ND_BREAK:
+			return true;
+		default:
+			break;
+	}
+	const struct Node* const children[] = {pNode->pThen, pNode->pElse, pNode->pBlock, pNode->pNext};
+	for (int i = 0; i < (int)(sizeof(children)/sizeof(children[0])); ++i)
+	{
+		if (HasUncopyable(children[i])) { return true; }
+	}
+	return false;
+}
+// 本体で値が変わらない式か(定数と本体で代入されない変数の四則演算)
+static bool IsInvariant(const struct Node* const pNode, const struct Node* const pBody)
+{
+	switch(pNode->kind)
+	{
+		case ND_NUM:
+			return true;
+		case ND_LVAR:
+			return !IsAssigned(pBody, pNode->pLVar, NULL);
+		case ND_ADD: case ND_SUB: case ND_MUL: case ND_DIV:
+			return IsInvariant(pNode->pLhs, pBody) && IsInvariant(pNode->pRhs, pBody);
+		default:
+			return false;
+	}
+}
+// i = i + c / i = c + i / i = i - c なら増分を返す
+static bool GetStep(const struct Node* const pNode, struct LocalVar** const ppLVar, int* const pStep)
+{
+	if (pNode->kind != ND_ASSIGN || pNode->pLhs->kind != ND_LVAR) { return false; }
+	struct LocalVar* const pLVar = pNode->pLhs->pLVar;
+	const struct Node* const pValue = pNode->pRhs;
+	if (pValue->kind != ND_ADD && pValue->kind != ND_SUB) { return false; }
+
+	const struct Node* pVar = pValue->pLhs;
+	const struct Node* pNum = pValue->pRhs;
+	if (pValue->kind == ND_ADD && pVar->kind == ND_NUM) { pVar = pValue->pRhs; pNum = pValue->pLhs; }
+	if (pVar->kind != ND_LVAR || pVar->pLVar != pLVar || pNum->kind != ND_NUM || pNum->value == 0) { return false; }
+	if (pValue->kind == ND_SUB && pNum->value == -2147483647 - 1) { return false; }
+
+	*ppLVar = pLVar;
+	*pStep = (pValue->kind == ND_ADD) ? pNum->value : -pNum->value;
+	return true;
+}
+// 本体の最後の文(ブロックでなければ本体そのもの)
+static const struct Node* GetLastStmt(const struct Node* const pBody)
+{
+	if (pBody->kind != ND_BLOCK) { return pBody; }
+	const struct Node* pLast = pBody->pBlock;
+	while(pLast != NULL && pLast->pNext != NULL) { pLast = pLast->pNext; }
+	return pLast;
+}
+static bool FindCountedLoop(const struct Node* const pNode, struct CountedLoop* const pLoop)
+{
+	const struct Node* const pCond = pNode->pCond;
+	const struct Node* const pBody = pNode->pThen;
+	if (pCond->kind != ND_LTH && pCond->kind != ND_LEQ) { return false; }
+
+	const struct Node* const pLast = GetLastStmt(pBody);
+	if (pLast == NULL || !GetStep(pLast, &pLoop->pVar, &pLoop->step)) { return false; }
+
+	// 増やすなら i < N, 減らすなら N < i
+	pLoop->isIncrement = (pLoop->step > 0);
+	const struct Node* const pVarSide = pLoop->isIncrement ? pCond->pLhs : pCond->pRhs;
+	pLoop->pBound = pLoop->isIncrement ? pCond->pRhs : pCond->pLhs;
+	if (pVarSide->kind != ND_LVAR || pVarSide->pLVar != pLoop->pVar) { return false; }
+
+	if (CountNodes(pBody, UNROLL_BODY_MAX) > UNROLL_BODY_MAX || CountNodes(pLoop->pBound, UNROLL_BODY_MAX) > UNROLL_BODY_MAX) { return false; }
+	if (IsAssigned(pBody, pLoop->pVar, pLast) || !IsInvariant(pLoop->pBound, pBody)) { return false; }
+	return !HasUncopyable(pBody);
+}
+
+// 式がpLVarへ代入するか(文の式は深いことがあるので作業スタックでたどる)
+static bool IsAssignedInExpr(struct MccContext* const pCtx, const struct Node* const pRoot, const struct LocalVar* const pLVar)
+{
+	int size = 0;
+	struct GenWork* pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, 1, sizeof(struct GenWork));
+	pWorks[size].pNode = pRoot;
+	pWorks[size++].phase = 0;
+	while(size > 0)
+	{
+		const struct Node* const pNode = pWorks[--size].pNode;
+		if (pNode->kind == ND_ASSIGN && pNode->pLhs->pLVar == pLVar) { return true; }
+		pWorks = (struct GenWork*)ReserveBuffer(&pCtx->genWorks, size + 2, sizeof(struct GenWork));
+		if (pNode->pLhs != NULL) { pWorks[size].pNode = pNode->pLhs; pWorks[size++].phase = 0; }
+		if (pNode->pRhs != NULL) { pWorks[size].pNode = pNode->pRhs; pWorks[size++].phase = 0; }
+	}
+	return false;
+}
+// 途中に飛び込まれない一続きの文か(式文と宣言だけの空のブロック)
+static bool IsStraightStmt(const struct Node* const pNode)
+{
+	switch(pNode->kind)
+	{
+		case ND_BLOCK:
+			return (pNode->pBlock == NULL);
+		case ND_RTN: case ND_IF: case ND_WHILE: case ND_SWITCH: case ND_CASE: case ND_DEFAULT: case ND_BREAK:
+			return false;
+		default:
+			return true;
+	}
+}
+// 反復回数: ループの直前の一続きの文(pRunから)で誘導変数に定数を代入し，条件の反対側も定数のとき
+// 分からなければ-1
+static long long GetTripCount(struct MccContext* const pCtx, const struct Node* const pNode, const struct Node* const pRun, const struct CountedLoop* const pLoop)
+{
+	if (pLoop->pBound->kind != ND_NUM) { return -1; }
+	bool isKnown = false;
+	long long first = 0;
+	for (const struct Node* pStmt = pRun; pStmt != NULL && pStmt != pNode; pStmt = pStmt->pNext)
+	{
+		if (pStmt->kind == ND_ASSIGN && pStmt->pLhs->pLVar == pLoop->pVar && pStmt->pRhs->kind == ND_NUM)
+		{
+			isKnown = true;
+			first = pStmt->pRhs->value;
+		}
+		else if (IsAssignedInExpr(pCtx, pStmt, pLoop->pVar))
+		{
+			isKnown = false;
+		}
+	}
+	if (!isKnown) { return -1; }
+
+	// 初期値から限界値(この値に届いたら終わり)までの距離
+	const long long bound = pLoop->pBound->value;
+	const long long inclusive = (pNode->pCond->kind == ND_LEQ) ? 1 : 0;
+	const long long step = pLoop->isIncrement ? pLoop->step : -(long long)pLoop->step;
+	const long long distance = pLoop->isIncrement ? (bound + inclusive) - first : first - (bound - inclusive);
+	const long long trip = (distance > 0) ? (distance + step - 1) / step : 0;
+
+	// intの変数が途中で桁あふれするなら元のループのままにする
+	const long long last = first + trip * pLoop->step;
+	if (pLoop->pVar->size == 4 && (last > 2147483647LL || last < -2147483647LL - 1)) { return -1; }
+	return trip;
+}
+// 本体をcount個並べたブロックにする
+static struct Node* CopyBody(struct MccContext* const pCtx, const struct Node* const pBody, const long long count)
+{
+	struct Node* const pBlock = NewNode(pCtx, ND_BLOCK, NULL, NULL, 0);
+	struct Node* pLast = NULL;
+	for (long long i = 0; i < count; ++i)
+	{
+		struct Node* const pCopy = CopyTree(pCtx, pBody);
+		if (pLast == NULL) { pBlock->pBlock = pCopy; }
+		else               { pLast->pNext = pCopy; }
+		pLast = pCopy;
+	}
+	return pBlock;
+}
+// F周分先まで条件が成り立つか: 条件 low < high なら (low < high) * (distance < high - low)
+// 差は条件が成り立つとき正なので，64bitで桁あふれしても負になって展開しない側へ倒れる
+static struct Node* CreateGuard(struct MccContext* const pCtx, const struct Node* const pCond, const int distance)
+{
+	struct Node* const pRange = NewNode(pCtx, ND_SUB, CopyTree(pCtx, pCond->pRhs), CopyTree(pCtx, pCond->pLhs), 0);
+	struct Node* const pAhead = NewNode(pCtx, pCond->kind, NewNode(pCtx, ND_NUM, NULL, NULL, distance), pRange, 0);
+	return NewNode(pCtx, ND_MUL, CopyTree(pCtx, pCond), pAhead, 0);
+}
+// whileノードをその場でブロックに置き換える(文の並びのつながりはそのまま)
+static void UnrollLoop(struct MccContext* const pCtx, struct Node* const pNode, const struct Node* const pRun)
+{
+	const int factor = pCtx->option.unrollFactor;
+	struct CountedLoop loop;
+	if (!FindCountedLoop(pNode, &loop)) { return; }
+	const int bodySize = CountNodes(pNode->pThen, UNROLL_BODY_MAX);
+
+	const long long trip = GetTripCount(pCtx, pNode, pRun, &loop);
+	if (trip >= 0 && trip <= UNROLL_FULL_TRIP_MAX && trip * bodySize <= UNROLL_FULL_NODE_MAX)
+	{
+		struct Node* const pBlock = CopyBody(pCtx, pNode->pThen, trip);
+		// 抜けたときの文の値(rax)は偽になった条件の値なので，最後に条件を残す
+		struct Node** ppTail = &pBlock->pBlock;
+		while (*ppTail != NULL) { ppTail = &(*ppTail)->pNext; }
+		*ppTail = CopyTree(pCtx, pNode->pCond);
+		pNode->kind = ND_BLOCK;
+		pNode->pBlock = pBlock->pBlock;
+		pNode->pCond = NULL;
+		pNode->pThen = NULL;
+		++pCtx->stats.unrollCount;
+		++pCtx->stats.fullUnrollCount;
+		return;
+	}
+
+	const long long distance = (long long)(factor - 1) * (loop.isIncrement ? loop.step : -(long long)loop.step);
+	if (distance > 2147483647LL) { return; }
+	struct Node* const pGuard = CreateGuard(pCtx, pNode->pCond, (int)distance);
+
+	// 展開したループ(プロファイルはこちらで取る)と残りを回す元のループ
+	struct Node* const pRemainder = CreateNewNode(pCtx);
+	*pRemainder = *pNode;
+	pRemainder->pNext = NULL;
+	pRemainder->srcPos = -1;
+	struct Node* const pMain = NewNode(pCtx, ND_WHILE, NULL, NULL, 0);
+	pMain->pCond = pGuard;
+	pMain->pThen = CopyBody(pCtx, pNode->pThen, factor);
+	pMain->srcPos = pNode->srcPos;
+	pMain->pNext = pRemainder;
+
+	pNode->kind = ND_BLOCK;
+	pNode->pBlock = pMain;
+	pNode->pCond = NULL;
+	pNode->pThen = NULL;
+	pNode->srcPos = -1;
+	++pCtx->stats.unrollCount;
+}
+
+// 文をたどり，内側のループから展開する．pRunは同じ並びでこの文の直前に続く一続きの文の先頭
+static void UnrollStmt(struct MccContext* const pCtx, struct Node* const pNode, const struct Node* const pRun);
+static void UnrollStmtList(struct MccContext* const pCtx, struct Node* const pFirst)
+{
+	const struct Node* pRun = NULL;
+	for (struct Node* pTmp = pFirst; pTmp != NULL; pTmp = pTmp->pNext)
+	{
+		UnrollStmt(pCtx, pTmp, (pRun != NULL) ? pRun : pTmp);
+		if (!IsStraightStmt(pTmp)) { pRun = NULL; }
+		else if (pRun == NULL)     { pRun = pTmp; }
+	}
+}
+static void UnrollStmt(struct MccContext* const pCtx, struct Node* const pNode, const struct Node* const pRun)
+{
+	switch(pNode->kind)
+	{
+		case ND_BLOCK:
+			UnrollStmtList(pCtx, pNode->pBlock);
+			return;
+		case ND_IF:
+			UnrollStmt(pCtx, pNode->pThen, pNode->pThen);
+			if (pNode->pElse != NULL) { UnrollStmt(pCtx, pNode->pElse, pNode->pElse); }
+			return;
+		case ND_SWITCH:
+		case ND_CASE:
+		case ND_DEFAULT:
+			UnrollStmt(pCtx, pNode->pThen, pNode->pThen);
+			return;
+		case ND_WHILE:
+			UnrollStmt(pCtx, pNode->pThen, pNode->pThen);
+			UnrollLoop(pCtx, pNode, pRun);
+			return;
+		default:
+			return;
+	}
+}
+void UnrollLoops(struct MccContext* const pCtx, struct Node* const pProgram)
+{
+	UnrollStmtList(pCtx, pProgram);
+}